@@ -1,5 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <immintrin.h>
+#include "pool.h"
+#include "bench.h"
 
 // BST node structure
 typedef struct node {
@@ -8,9 +13,12 @@ typedef struct node {
 	struct node *right;
 } node;
 
+// All BST nodes come from this pool and are released together
+static pool node_pool = POOL_INIT(node);
+
 // Creates a new BST node with the given value
 node *create_node(int data) {
-	node *n = (node *) malloc(sizeof(node));
+	node *n = (node *) pool_alloc(&node_pool);
 	n -> data = data;
 	n -> left = n -> right = NULL;
 	return n;
@@ -42,80 +50,270 @@ node *find_max(node *root) {
 	return root;
 }
 
-// Iterative preorder traversal (Root, Left, Right)
-void preorder(node *root) {
-	if(!root)
-		return;
-
-	node *stack[100];
-	int top = -1;
-
-	stack[++top] = root;
+// Traversal orders supported by the iterators
+typedef enum order {
+	PREORDER,
+	INORDER,
+	POSTORDER
+} order;
+
+// Pull-style traversal iterator using Morris threading: O(1) extra memory
+// and no depth limit. While iterating, the tree is temporarily rethreaded
+// (a predecessor's NULL right pointer points back to its successor); it is
+// fully restored once next() returns NULL or iter_close() is called.
+// The iterator holds a pointer to itself, so it must not be copied.
+typedef struct bst_iter {
+	order ord;
+	node *curr;        // next subtree root to thread through
+	node dummy;        // postorder: fake root with the tree as left child
+	node *emit;        // postorder: rest of a reversed right edge to emit
+	node *emit_prev;   // postorder: used to undo the reversal while emitting
+} bst_iter;
+
+// Start a traversal of root in the given order
+void iter_init(bst_iter *it, node *root, order ord) {
+	it -> ord = ord;
+	it -> curr = root;
+	it -> emit = it -> emit_prev = NULL;
+	if(ord == POSTORDER) {
+		it -> dummy.left = root;
+		it -> dummy.right = NULL;
+		it -> curr = &it -> dummy;
+	}
+}
 
-	while(top >= 0) {
-		node *curr = stack[top--];
-		printf("%d ", curr -> data); // Visit the node
+// Rightmost node of curr's left subtree, stopping at a thread back to curr
+node *predecessor(node *curr) {
+	node *pred = curr -> left;
+	while(pred -> right && pred -> right != curr)
+		pred = pred -> right;
+	return pred;
+}
 
-		// Push right child first so left child is processed first (LIFO order)
-		if(curr -> right)
-			stack[++top] = curr -> right;
-		if(curr -> left)
-			stack[++top] = curr -> left;
+// Reverse the right pointers along a right edge, returning its old tail
+node *reverse_edge(node *head) {
+	node *prev = NULL;
+	while(head) {
+		node *next = head -> right;
+		head -> right = prev;
+		prev = head;
+		head = next;
 	}
-	printf("\n");
+	return prev;
 }
 
-// Iterative inorder traversal (Left, Root, Right)
-void inorder(node *root) {
-	node *stack[100];
-	int top = -1;
-	node *curr = root;
-
-	while(curr || top >= 0) {
-		// Reach the leftmost node of the current subtree
-		while(curr) {
-			stack[++top] = curr;
-			curr = curr -> left;
+// Return the next node of the traversal, or NULL when it is finished
+node *iter_next(bst_iter *it) {
+	// Postorder: emit a reversed right edge bottom-up, restoring it as we go
+	if(it -> emit) {
+		node *x = it -> emit;
+		it -> emit = x -> right;
+		x -> right = it -> emit_prev;
+		it -> emit_prev = x;
+		return x;
+	}
+
+	while(it -> curr) {
+		node *curr = it -> curr;
+
+		if(!curr -> left) {
+			it -> curr = curr -> right;
+			if(it -> ord != POSTORDER)
+				return curr;
+			continue;
 		}
 
-		// Pop the minimum value from the stack.
-		curr = stack[top--];
-		printf("%d ", curr -> data);
+		node *pred = predecessor(curr);
 
-		// Traverse the right subtree
-		curr = curr -> right;
+		// First visit: thread the predecessor back to curr and go left
+		if(!pred -> right) {
+			pred -> right = curr;
+			it -> curr = curr -> left;
+			if(it -> ord == PREORDER)
+				return curr;
+			continue;
+		}
+
+		// Second visit: the left subtree is done, remove the thread
+		pred -> right = NULL;
+		it -> curr = curr -> right;
+		if(it -> ord == INORDER)
+			return curr;
+		if(it -> ord == POSTORDER) {
+			it -> emit = reverse_edge(curr -> left);
+			it -> emit_prev = NULL;
+			return iter_next(it);
+		}
 	}
+	return NULL;
+}
+
+// Abandon a traversal early; runs it to completion to remove all threads
+void iter_close(bst_iter *it) {
+	while(iter_next(it))
+		;
+}
+
+// Call visit(n, ctx) for every node in the given order
+void walk(node *root, order ord, void (*visit)(node *, void *), void *ctx) {
+	bst_iter it;
+	node *n;
+
+	iter_init(&it, root, ord);
+	while((n = iter_next(&it)))
+		visit(n, ctx);
+}
+
+void print_node(node *n, void *ctx) {
+	(void) ctx;
+	printf("%d ", n -> data);
+}
+
+// Preorder traversal (Root, Left, Right)
+void preorder(node *root) {
+	walk(root, PREORDER, print_node, NULL);
 	printf("\n");
 }
 
-// Iterative postorder traversal (Left, Right, Root)
+// Inorder traversal (Left, Root, Right)
+void inorder(node *root) {
+	walk(root, INORDER, print_node, NULL);
+	printf("\n");
+}
+
+// Postorder traversal (Left, Right, Root)
 void postorder(node *root) {
-	node *stack1[100], *stack2[100];
-	int top1 = -1, top2 = -1;
+	walk(root, POSTORDER, print_node, NULL);
+	printf("\n");
+}
 
-	if(!root)
+// Iterative lookup in the pointer-based tree
+node *search(node *root, int data) {
+	while(root && root -> data != data)
+		root = data < root -> data ? root -> left : root -> right;
+	return root;
+}
+
+// Read-only snapshot of a BST in Eytzinger (BFS) order: the children of
+// keys[k] are keys[2k] and keys[2k + 1]. The array is padded with INT_MAX
+// to a complete tree so every search takes exactly height steps.
+typedef struct frozen_bst {
+	int *keys;        // keys[1..cap], keys[0] unused
+	long n;           // real keys
+	long cap;         // 2^height - 1
+	int height;
+	int has_max;      // INT_MAX is a real key, not just padding
+} frozen_bst;
+
+// Lay out sorted[] in BFS order by an inorder walk over implicit indices
+void fill_eytzinger(frozen_bst *f, const int *sorted, long *i, long k) {
+	if(k > f -> cap)
 		return;
+	fill_eytzinger(f, sorted, i, 2 * k);
+	f -> keys[k] = *i < f -> n ? sorted[*i] : INT_MAX;
+	(*i)++;
+	fill_eytzinger(f, sorted, i, 2 * k + 1);
+}
 
-	// stack1 is used for processing
-	// stack2 stores the reverse order
-	stack1[++top1] = root;
+// Build a frozen snapshot of the tree; the tree itself is left unchanged
+frozen_bst freeze(node *root) {
+	frozen_bst f = {0};
+	bst_iter it;
+	node *x;
+
+	iter_init(&it, root, INORDER);
+	while(iter_next(&it))
+		f.n++;
+
+	int *sorted = (int *) malloc((f.n ? f.n : 1) * sizeof(int));
+	long i = 0;
+	iter_init(&it, root, INORDER);
+	while((x = iter_next(&it)))
+		sorted[i++] = x -> data;
+
+	while(f.cap < f.n) {
+		f.cap = 2 * f.cap + 1;
+		f.height++;
+	}
+	f.has_max = f.n && sorted[f.n - 1] == INT_MAX;
 
-	while(top1 >= 0) {
-		node *curr = stack1[top1--];
-		stack2[++top2] = curr;
+	// 64-byte alignment keeps each group of 16 grandchildren on one cache line
+	size_t bytes = ((f.cap + 1) * sizeof(int) + 63) & ~(size_t) 63;
+	f.keys = (int *) aligned_alloc(64, bytes);
+	i = 0;
+	fill_eytzinger(&f, sorted, &i, 1);
 
-		// Push left and right children to stack1 for later processing
-		if(curr -> left)
-			stack1[++top1] = curr -> left;
-		if(curr -> right)
-			stack1[++top1] = curr -> right;
+	free(sorted);
+	return f;
+}
+
+void free_frozen(frozen_bst *f) {
+	free(f -> keys);
+	f -> keys = NULL;
+	f -> n = f -> cap = 0;
+}
+
+// Map a finished descent back to the key it stopped at (0 if none)
+int frozen_hit(const frozen_bst *f, unsigned long k, int data) {
+	// Strip the trailing right turns plus the last left turn: lower bound index
+	k >>= __builtin_ffsl(~k);
+	return k && f -> keys[k] == data && (data != INT_MAX || f -> has_max);
+}
+
+// Branchless lookup with software prefetch of the line 4 levels below
+int frozen_search(const frozen_bst *f, int data) {
+	unsigned long k = 1;
+	for(int h = 0; h < f -> height; h++) {
+		__builtin_prefetch(f -> keys + 16 * k);
+		k = 2 * k + (f -> keys[k] < data);
 	}
+	return frozen_hit(f, k, data);
+}
 
-	// Pop all nodes from stack2 to print postorder
-	while(top2 >= 0)
-		printf("%d ", stack2[top2--] -> data);
+// Scalar batched lookup: 8 independent descents interleaved to overlap misses
+void frozen_search_batch_scalar(const frozen_bst *f, const int *data, int *found, long m) {
+	long i = 0;
+	for(; i + 8 <= m; i += 8) {
+		unsigned long k[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+		for(int h = 0; h < f -> height; h++)
+			for(int j = 0; j < 8; j++)
+				k[j] = 2 * k[j] + (f -> keys[k[j]] < data[i + j]);
+		for(int j = 0; j < 8; j++)
+			found[i + j] = frozen_hit(f, k[j], data[i + j]);
+	}
+	for(; i < m; i++)
+		found[i] = frozen_search(f, data[i]);
+}
 
-	printf("\n");
+// AVX2 batched lookup: 8 descents per register using gathers
+__attribute__((target("avx2")))
+void frozen_search_batch_avx2(const frozen_bst *f, const int *data, int *found, long m) {
+	long i = 0;
+	for(; i + 8 <= m; i += 8) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (data + i));
+		__m256i k = _mm256_set1_epi32(1);
+		for(int h = 0; h < f -> height; h++) {
+			__m256i v = _mm256_i32gather_epi32(f -> keys, k, 4);
+			// lt is -1 where keys[k] < data, so k - lt adds the right turn
+			__m256i lt = _mm256_cmpgt_epi32(x, v);
+			k = _mm256_sub_epi32(_mm256_add_epi32(k, k), lt);
+		}
+		unsigned int idx[8];
+		_mm256_storeu_si256((__m256i *) idx, k);
+		for(int j = 0; j < 8; j++)
+			found[i + j] = frozen_hit(f, idx[j], data[i + j]);
+	}
+	for(; i < m; i++)
+		found[i] = frozen_search(f, data[i]);
+}
+
+// Look up m keys at once, using AVX2 when the CPU has it
+void frozen_search_batch(const frozen_bst *f, const int *data, int *found, long m) {
+	// 32-bit gather indices cover trees of up to 2^30 - 1 slots
+	if(__builtin_cpu_supports("avx2") && f -> height <= 30)
+		frozen_search_batch_avx2(f, data, found, m);
+	else
+		frozen_search_batch_scalar(f, data, found, m);
 }
 
 // Prints the BST in a rotated tree structure (right-subtree on top)
@@ -138,7 +336,167 @@ void print_tree(node *root, int space) {
 	print_tree(root -> left, space);
 }
 
-int main() {
+// Free every node of the tree in one pass over the pool
+void free_tree(void) {
+	pool_destroy(&node_pool);
+}
+
+// Build a tree from n random keys and report allocator cost
+int bench_alloc(long n) {
+	uint64_t seed = 42;
+	node *root = NULL;
+	long rss_before = rss_kb();
+	double t = now_sec();
+
+	for(long i = 0; i < n; i++)
+		root = insert(root, (int) (bench_rand(&seed) >> 33));
+
+	double elapsed = now_sec() - t;
+	printf("%ld random inserts: %.3f s (%.1f ns/insert)\n", n, elapsed, elapsed * 1e9 / n);
+	pool_report("BST nodes", &node_pool);
+	printf("RSS growth: %ld kB\n", rss_kb() - rss_before);
+
+	free_tree();
+	return 0;
+}
+
+// Fully skewed tree (what insert builds from sorted input), built in O(n)
+node *build_chain(long n) {
+	node *root = NULL, *tail = NULL;
+	for(long i = 0; i < n; i++) {
+		node *x = create_node((int) i);
+		if(tail)
+			tail -> right = x;
+		else
+			root = x;
+		tail = x;
+	}
+	return root;
+}
+
+// Time all three iterator orders over one tree and check the inorder is sorted
+void bench_orders(const char *name, node *root, long n) {
+	static const char *names[] = {"preorder", "inorder", "postorder"};
+
+	for(int ord = PREORDER; ord <= POSTORDER; ord++) {
+		bst_iter it;
+		node *x, *prev = NULL;
+		long count = 0, sorted = 1;
+		long rss_before = rss_kb();
+		double t = now_sec();
+
+		iter_init(&it, root, (order) ord);
+		while((x = iter_next(&it))) {
+			if(ord == INORDER && prev && prev -> data >= x -> data)
+				sorted = 0;
+			prev = x;
+			count++;
+		}
+
+		double elapsed = now_sec() - t;
+		printf("%-7s %-9s: %ld nodes, %.3f s (%.1f ns/node), RSS growth %ld kB%s\n",
+		       name, names[ord], count, elapsed, elapsed * 1e9 / n,
+		       rss_kb() - rss_before, count != n || !sorted ? "  MISMATCH" : "");
+	}
+}
+
+// Iterate over a skewed and a random tree of n nodes
+int bench_iter(long n) {
+	node *root = build_chain(n);
+	bench_orders("skewed", root, n);
+	free_tree();
+
+	// Random keys may repeat; count the distinct ones actually inserted
+	uint64_t seed = 42;
+	root = NULL;
+	for(long i = 0; i < n; i++)
+		root = insert(root, (int) (bench_rand(&seed) >> 33));
+	bench_orders("random", root, (long) node_pool.live);
+	free_tree();
+	return 0;
+}
+
+// Compare lookups/s of the pointer tree against its frozen snapshot
+int bench_freeze(long n) {
+	const long m = 10000000;
+	uint64_t seed = 42;
+	node *root = NULL;
+
+	// Keys drawn from [0, 2n) so roughly 40% of the lookups hit
+	for(long i = 0; i < n; i++)
+		root = insert(root, (int) (bench_rand(&seed) % (2 * n)));
+
+	double t = now_sec();
+	frozen_bst f = freeze(root);
+	printf("%ld keys, frozen in %.3f s (height %d, %.1f MB)\n",
+	       f.n, now_sec() - t, f.height, (f.cap + 1) * sizeof(int) / (1024.0 * 1024.0));
+
+	int *queries = (int *) malloc(m * sizeof(int));
+	int *found = (int *) malloc(m * sizeof(int));
+	for(long i = 0; i < m; i++)
+		queries[i] = (int) (bench_rand(&seed) % (2 * n));
+
+	long hits[4] = {0};
+	double secs[4];
+	const char *names[] = {"pointer walk", "frozen branchless", "frozen batch scalar", "frozen batch AVX2"};
+
+	t = now_sec();
+	for(long i = 0; i < m; i++)
+		hits[0] += search(root, queries[i]) != NULL;
+	secs[0] = now_sec() - t;
+
+	t = now_sec();
+	for(long i = 0; i < m; i++)
+		hits[1] += frozen_search(&f, queries[i]);
+	secs[1] = now_sec() - t;
+
+	t = now_sec();
+	frozen_search_batch_scalar(&f, queries, found, m);
+	secs[2] = now_sec() - t;
+	for(long i = 0; i < m; i++)
+		hits[2] += found[i];
+
+	int methods = 3;
+	if(__builtin_cpu_supports("avx2")) {
+		t = now_sec();
+		frozen_search_batch(&f, queries, found, m);
+		secs[3] = now_sec() - t;
+		for(long i = 0; i < m; i++)
+			hits[3] += found[i];
+		methods = 4;
+	}
+
+	for(int i = 0; i < methods; i++)
+		printf("%-20s: %6.1f M lookups/s, %ld hits%s\n", names[i], m / secs[i] / 1e6,
+		       hits[i], hits[i] != hits[0] ? "  MISMATCH" : "");
+
+	free(queries);
+	free(found);
+	free_frozen(&f);
+	free_tree();
+	return 0;
+}
+
+// bench [alloc|iter|freeze] [n]
+int bench(int argc, char **argv) {
+	const char *mode = argc > 2 ? argv[2] : "alloc";
+	long n = argc > 3 ? atol(argv[3]) : 1000000;
+
+	if(!strcmp(mode, "alloc"))
+		return bench_alloc(n);
+	if(!strcmp(mode, "iter"))
+		return bench_iter(n);
+	if(!strcmp(mode, "freeze"))
+		return bench_freeze(n);
+
+	fprintf(stderr, "unknown bench mode: %s\n", mode);
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	if(argc > 1 && !strcmp(argv[1], "bench"))
+		return bench(argc, argv);
+
 	node *root = NULL;
 
 	// Example input values to construct the BST
@@ -165,5 +523,6 @@ int main() {
 	if(max)
 		printf("\nMaximum Value: %d\n", max -> data);
 
+	free_tree();
 	return 0;
 }
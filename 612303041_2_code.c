@@ -1,4 +1,27 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <limits.h>
+#include <immintrin.h>
+#include "bench.h"
+
+// The demo traces every divide and merge step. The trace is a compile-time
+// switch: -DNDEBUG (or -DMERGE_TRACE=0) compiles it out of merge/merge_sort.
+#ifndef MERGE_TRACE
+#ifdef NDEBUG
+#define MERGE_TRACE 0
+#else
+#define MERGE_TRACE 1
+#endif
+#endif
 
 void print_array(int arr[], int n) {
 	for (int i = 0; i < n; i++) {
@@ -7,56 +30,1335 @@ void print_array(int arr[], int n) {
 	printf("\n");
 }
 
-void merge(int *arr, int left, int mid, int right) {
-	int n1 = mid - left + 1;
-	int n2 = right - mid;
-
-	int L[n1], R[n2];
+void trace_range(const char *label, int *arr, int left, int right) {
+	printf("%s: ", label);
+	for (int i = left; i <= right; i++)
+		printf("%d ", arr[i]);
+	printf("\n");
+}
 
-	for (int i = 0; i < n1; i++)
-		L[i] = arr[left + i];
+// Merge arr[left..mid] and arr[mid+1..right]. Only the left run is copied
+// out (into tmp, which must hold mid - left + 1 ints); the right run is
+// merged in place since the output never overtakes it.
+void merge(int *arr, int *tmp, int left, int mid, int right) {
+	int n1 = mid - left + 1;
 
-	for (int j = 0; j < n2; j++)
-		R[j] = arr[mid + 1 + j];
+	memcpy(tmp, arr + left, n1 * sizeof(int));
 
-	int i = 0, j = 0, k = left;
+	int i = 0, j = mid + 1, k = left;
 
-	while (i < n1 && j < n2) {
-		if (L[i] <= R[j])
-			arr[k++] = L[i++];
+	while (i < n1 && j <= right) {
+		if (tmp[i] <= arr[j])
+			arr[k++] = tmp[i++];
 		else
-			arr[k++] = R[j++];
+			arr[k++] = arr[j++];
 	}
 
 	while (i < n1)
-		arr[k++] = L[i++];
-
-	while (j < n2)
-		arr[k++] = R[j++];
+		arr[k++] = tmp[i++];
 
-	printf("Clubbing: ");
-	for (int x = left; x <= right; x++)
-		printf("%d ", arr[x]);
-	printf("\n");
+	if (MERGE_TRACE)
+		trace_range("Clubbing", arr, left, right);
 }
 
-void merge_sort(int *arr, int left, int right) {
+// Top-down merge sort; tmp is one scratch buffer of at least (n + 1) / 2 ints
+void merge_sort(int *arr, int *tmp, int left, int right) {
 	if (left >= right)
 		return;
 
 	int mid = (left + right) / 2;
 
-	printf("Dividing: ");
-	for (int i = left; i <= right; i++)
-		printf("%d ", arr[i]);
-	printf("\n");
+	if (MERGE_TRACE)
+		trace_range("Dividing", arr, left, right);
+
+	merge_sort(arr, tmp, left, mid);
+	merge_sort(arr, tmp, mid + 1, right);
+	merge(arr, tmp, left, mid, right);
+}
+
+// Parallel merge sort on a work-stealing thread pool
+
+#define MAX_WORKERS 64
+#define DEQUE_CAP 1024
+#define INSERTION_CUTOFF 32      // ranges this small use insertion sort
+#define SORT_CUTOFF (1 << 14)    // ranges this small are sorted sequentially
+#define MERGE_CUTOFF (1 << 14)   // merges this small are done sequentially
+
+// A unit of work; the spawning frame owns it and waits for done
+typedef struct task {
+	void (*fn)(void *arg);
+	void *arg;
+	atomic_int done;
+} task;
+
+// Per-worker deque: the owner pushes/pops at bottom, thieves take from top
+typedef struct deque {
+	pthread_mutex_t lock;
+	task *items[DEQUE_CAP];
+	long top, bottom;
+} deque;
+
+typedef struct thread_pool {
+	int count;
+	pthread_t threads[MAX_WORKERS];
+	deque queues[MAX_WORKERS];
+	atomic_int stop;
+} thread_pool;
+
+static thread_pool *workers;
+static __thread int worker_id;
+
+void run_task(task *t) {
+	t -> fn(t -> arg);
+	atomic_store_explicit(&t -> done, 1, memory_order_release);
+}
+
+// Push onto our own deque; runs the task inline if the deque is full
+void spawn(task *t, void (*fn)(void *), void *arg) {
+	deque *q = &workers -> queues[worker_id];
+	t -> fn = fn;
+	t -> arg = arg;
+	atomic_init(&t -> done, 0);
+
+	pthread_mutex_lock(&q -> lock);
+	if (q -> bottom - q -> top < DEQUE_CAP) {
+		q -> items[q -> bottom++ % DEQUE_CAP] = t;
+		pthread_mutex_unlock(&q -> lock);
+		return;
+	}
+	pthread_mutex_unlock(&q -> lock);
+	run_task(t);
+}
+
+task *pop_bottom(deque *q) {
+	task *t = NULL;
+	pthread_mutex_lock(&q -> lock);
+	if (q -> bottom > q -> top)
+		t = q -> items[--q -> bottom % DEQUE_CAP];
+	pthread_mutex_unlock(&q -> lock);
+	return t;
+}
+
+task *steal_top(deque *q) {
+	task *t = NULL;
+	if (pthread_mutex_trylock(&q -> lock))
+		return NULL;
+	if (q -> bottom > q -> top)
+		t = q -> items[q -> top++ % DEQUE_CAP];
+	pthread_mutex_unlock(&q -> lock);
+	return t;
+}
+
+// Try every other worker's deque once, starting at a random victim
+task *steal(unsigned *seed) {
+	int n = workers -> count;
+	int start = rand_r(seed) % n;
+	for (int i = 0; i < n; i++) {
+		int victim = (start + i) % n;
+		if (victim == worker_id)
+			continue;
+		task *t = steal_top(&workers -> queues[victim]);
+		if (t)
+			return t;
+	}
+	return NULL;
+}
+
+// Wait for a spawned task, running it ourselves or helping others meanwhile.
+// Steals take the oldest task first, so if t was stolen our deque is empty.
+void sync_task(task *t) {
+	unsigned seed = worker_id * 7919 + 1;
+	while (!atomic_load_explicit(&t -> done, memory_order_acquire)) {
+		task *x = pop_bottom(&workers -> queues[worker_id]);
+		if (!x)
+			x = steal(&seed);
+		if (x)
+			run_task(x);
+		else
+			sched_yield();
+	}
+}
+
+void *worker_loop(void *arg) {
+	worker_id = (int) (long) arg;
+	unsigned seed = worker_id * 7919 + 1;
+
+	while (!atomic_load(&workers -> stop)) {
+		task *x = pop_bottom(&workers -> queues[worker_id]);
+		if (!x)
+			x = steal(&seed);
+		if (x)
+			run_task(x);
+		else
+			sched_yield();
+	}
+	return NULL;
+}
+
+// Start workers 1..n-1; the calling thread acts as worker 0
+void workers_start(thread_pool *p, int count) {
+	workers = p;
+	p -> count = count;
+	atomic_init(&p -> stop, 0);
+	for (int i = 0; i < count; i++) {
+		pthread_mutex_init(&p -> queues[i].lock, NULL);
+		p -> queues[i].top = p -> queues[i].bottom = 0;
+	}
+	worker_id = 0;
+	for (int i = 1; i < count; i++)
+		pthread_create(&p -> threads[i], NULL, worker_loop, (void *) (long) i);
+}
+
+void workers_stop(thread_pool *p) {
+	atomic_store(&p -> stop, 1);
+	for (int i = 1; i < p -> count; i++)
+		pthread_join(p -> threads[i], NULL);
+	for (int i = 0; i < p -> count; i++)
+		pthread_mutex_destroy(&p -> queues[i].lock);
+	workers = NULL;
+}
+
+void insertion_sort(int *arr, long n) {
+	for (long i = 1; i < n; i++) {
+		int key = arr[i];
+		long j = i - 1;
+		while (j >= 0 && arr[j] > key) {
+			arr[j + 1] = arr[j];
+			j--;
+		}
+		arr[j + 1] = key;
+	}
+}
+
+// Merge sorted a[0..na) and b[0..nb) into out
+void merge_into(const int *a, long na, const int *b, long nb, int *out) {
+	long i = 0, j = 0, k = 0;
+	while (i < na && j < nb) {
+		if (a[i] <= b[j])
+			out[k++] = a[i++];
+		else
+			out[k++] = b[j++];
+	}
+	while (i < na)
+		out[k++] = a[i++];
+	while (j < nb)
+		out[k++] = b[j++];
+}
+
+// First index in b[0..n) whose value is >= key
+long lower_bound(const int *b, long n, int key) {
+	long lo = 0, hi = n;
+	while (lo < hi) {
+		long mid = lo + (hi - lo) / 2;
+		if (b[mid] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// First index in b[0..n) whose value is > key
+long upper_bound(const int *b, long n, int key) {
+	long lo = 0, hi = n;
+	while (lo < hi) {
+		long mid = lo + (hi - lo) / 2;
+		if (b[mid] <= key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Sequential sort of src; result lands in dst if to_dst, else in src.
+// Both halves are sorted into the other buffer so no copy-back is needed.
+void seq_sort(int *src, int *dst, long n, int to_dst) {
+	if (n <= INSERTION_CUTOFF) {
+		insertion_sort(src, n);
+		if (to_dst)
+			memcpy(dst, src, n * sizeof(int));
+		return;
+	}
+	long half = n / 2;
+	seq_sort(src, dst, half, !to_dst);
+	seq_sort(src + half, dst + half, n - half, !to_dst);
+	if (to_dst)
+		merge_into(src, half, src + half, n - half, dst);
+	else
+		merge_into(dst, half, dst + half, n - half, src);
+}
+
+typedef struct merge_job {
+	const int *a, *b;
+	long na, nb;
+	int *out;
+} merge_job;
+
+// Parallel merge: split the larger run at its middle, binary search the
+// split point in the other run, and merge the two halves independently
+void par_merge(void *arg) {
+	merge_job *j = (merge_job *) arg;
+	const int *a = j -> a, *b = j -> b;
+	long na = j -> na, nb = j -> nb;
+
+	if (na + nb <= MERGE_CUTOFF) {
+		merge_into(a, na, b, nb, j -> out);
+		return;
+	}
+	// Split the larger run; equal keys from a always land before those from b
+	long ma, mb;
+	if (na >= nb) {
+		ma = na / 2;
+		mb = lower_bound(b, nb, a[ma]);
+	} else {
+		mb = nb / 2;
+		ma = upper_bound(a, na, b[mb]);
+	}
+	merge_job left = {a, b, ma, mb, j -> out};
+	merge_job right = {a + ma, b + mb, na - ma, nb - mb, j -> out + ma + mb};
+	task t;
+	spawn(&t, par_merge, &left);
+	par_merge(&right);
+	sync_task(&t);
+}
+
+typedef struct sort_job {
+	int *src, *dst;
+	long n;
+	int to_dst;
+} sort_job;
+
+void par_sort(void *arg) {
+	sort_job *j = (sort_job *) arg;
+	if (j -> n <= SORT_CUTOFF) {
+		seq_sort(j -> src, j -> dst, j -> n, j -> to_dst);
+		return;
+	}
+	long half = j -> n / 2;
+	sort_job left = {j -> src, j -> dst, half, !j -> to_dst};
+	sort_job right = {j -> src + half, j -> dst + half, j -> n - half, !j -> to_dst};
+	task t;
+	spawn(&t, par_sort, &left);
+	par_sort(&right);
+	sync_task(&t);
+
+	merge_job m;
+	if (j -> to_dst)
+		m = (merge_job) {j -> src, j -> src + half, half, j -> n - half, j -> dst};
+	else
+		m = (merge_job) {j -> dst, j -> dst + half, half, j -> n - half, j -> src};
+	par_merge(&m);
+}
+
+// Sort arr[0..n) with the given number of threads (1 runs sequentially)
+void parallel_merge_sort(int *arr, long n, int threads) {
+	int *tmp = (int *) malloc((n ? n : 1) * sizeof(int));
+	if (threads < 1)
+		threads = 1;
+	if (threads > MAX_WORKERS)
+		threads = MAX_WORKERS;
+
+	if (threads == 1) {
+		seq_sort(arr, tmp, n, 0);
+	} else {
+		// the deques are ~0.5 MB, too big for a caller's stack
+		thread_pool *p = (thread_pool *) malloc(sizeof(thread_pool));
+		workers_start(p, threads);
+		sort_job root = {arr, tmp, n, 0};
+		par_sort(&root);
+		workers_stop(p);
+		free(p);
+	}
+	free(tmp);
+}
+
+// Bottom-up natural merge sort (TimSort-style runs and galloping)
+
+#define MIN_RUN 32       // shorter natural runs are extended by insertion sort
+#define MIN_GALLOP 7     // wins in a row before a merge switches to galloping
+
+// Sort arr[start..n) given that arr[0..start) is already sorted
+void binary_insertion_sort(int *arr, long start, long n) {
+	for (long i = start; i < n; i++) {
+		int key = arr[i];
+		long pos = upper_bound(arr, i, key);
+		memmove(arr + pos + 1, arr + pos, (i - pos) * sizeof(int));
+		arr[pos] = key;
+	}
+}
+
+// Length of the natural run at arr[0..n); strictly descending runs are
+// reversed in place (strictness keeps equal keys in order)
+long find_run(int *arr, long n) {
+	long len = 1;
+	if (n < 2)
+		return n;
+
+	if (arr[1] < arr[0]) {
+		while (len < n && arr[len] < arr[len - 1])
+			len++;
+		for (long i = 0, j = len - 1; i < j; i++, j--) {
+			int t = arr[i];
+			arr[i] = arr[j];
+			arr[j] = t;
+		}
+	} else {
+		while (len < n && arr[len] >= arr[len - 1])
+			len++;
+	}
+	return len;
+}
+
+// Number of leading elements of arr[0..n) that are < key (<= key if
+// inclusive), found by exponential search followed by binary search
+long gallop(const int *arr, long n, int key, int inclusive) {
+	long lo = 0, hi = 1;
+	while (hi <= n && (inclusive ? arr[hi - 1] <= key : arr[hi - 1] < key)) {
+		lo = hi;
+		hi *= 2;
+	}
+	if (hi > n)
+		hi = n;
+	// arr[0..lo) passes; the first failing element lies in [lo, hi]
+	return lo + (inclusive ? upper_bound(arr + lo, hi - lo, key)
+	                       : lower_bound(arr + lo, hi - lo, key));
+}
+
+// Merge a[0..na) and b[0..nb) into out. Once one side wins min_gallop
+// times in a row, the rest of its winning stretch is found by galloping and
+// copied in one block. As in TimSort, min_gallop adapts: it drops while
+// galloping pays off and grows when it does not (e.g. on random data).
+void gallop_merge(const int *a, long na, const int *b, long nb, int *out) {
+	long i = 0, j = 0, k = 0;
+	int min_gallop = MIN_GALLOP;
+
+	while (i < na && j < nb) {
+		int streak = 0, last = -1;
+
+		// One-at-a-time mode (branch-free select) until one side has won
+		// min_gallop times in a row
+		while (streak < min_gallop) {
+			int take_b = b[j] < a[i];
+			out[k++] = take_b ? b[j] : a[i];
+			j += take_b;
+			i += !take_b;
+			streak = take_b == last ? streak + 1 : 1;
+			last = take_b;
+			if (i == na || j == nb)
+				goto done;
+		}
+
+		long run;
+		if (!last) {
+			run = gallop(a + i, na - i, b[j], 1);
+			memcpy(out + k, a + i, run * sizeof(int));
+			i += run;
+		} else {
+			run = gallop(b + j, nb - j, a[i], 0);
+			memcpy(out + k, b + j, run * sizeof(int));
+			j += run;
+		}
+		k += run;
+
+		if (run >= MIN_GALLOP) {
+			if (min_gallop > 1)
+				min_gallop--;
+		} else {
+			min_gallop += 2;
+		}
+	}
+done:
+	memcpy(out + k, a + i, (na - i) * sizeof(int));
+	k += na - i;
+	memcpy(out + k, b + j, (nb - j) * sizeof(int));
+}
+
+// Sort arr[0..n): split into natural runs (at least MIN_RUN long), then
+// merge neighbouring runs pass by pass, ping-ponging between arr and one
+// auxiliary buffer allocated up front. Already-sorted or reversed input
+// is a single run and costs one linear scan.
+void natural_merge_sort(int *arr, long n) {
+	if (n < 2)
+		return;
+
+	// Run boundaries: run r is [bounds[r], bounds[r + 1])
+	long *bounds = (long *) malloc((n / MIN_RUN + 2) * sizeof(long));
+	long runs = 0;
+
+	for (long start = 0; start < n; ) {
+		long len = find_run(arr + start, n - start);
+		if (len < MIN_RUN) {
+			long forced = n - start < MIN_RUN ? n - start : MIN_RUN;
+			binary_insertion_sort(arr + start, len, forced);
+			len = forced;
+		}
+		bounds[runs++] = start;
+		start += len;
+	}
+	bounds[runs] = n;
+
+	if (runs == 1) {
+		free(bounds);
+		return;
+	}
+
+	int *tmp = (int *) malloc(n * sizeof(int));
+	int *src = arr, *dst = tmp;
+
+	while (runs > 1) {
+		long merged = 0;
+		for (long r = 0; r < runs; r += 2) {
+			long lo = bounds[r];
+			if (r + 1 < runs) {
+				long mid = bounds[r + 1], hi = bounds[r + 2];
+				gallop_merge(src + lo, mid - lo, src + mid, hi - mid, dst + lo);
+			} else {
+				memcpy(dst + lo, src + lo, (n - lo) * sizeof(int));
+			}
+			bounds[merged++] = lo;
+		}
+		bounds[merged] = n;
+		runs = merged;
+
+		int *t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != arr)
+		memcpy(arr, src, n * sizeof(int));
+	free(tmp);
+	free(bounds);
+}
+
+// External merge sort for binary files of native-endian ints
+
+#define MIN_IO_INTS (1 << 14)   // smallest merge buffer: 64 KB
+
+void die(const char *what) {
+	perror(what);
+	exit(1);
+}
+
+// read()/write() the whole range, retrying short transfers
+long read_full(int fd, void *buf, long bytes) {
+	long done = 0;
+	while (done < bytes) {
+		ssize_t r = read(fd, (char *) buf + done, bytes - done);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0)
+			die("read");
+		if (r == 0)
+			break;
+		done += r;
+	}
+	return done;
+}
+
+void write_full(int fd, const void *buf, long bytes) {
+	long done = 0;
+	while (done < bytes) {
+		ssize_t w = write(fd, (const char *) buf + done, bytes - done);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w < 0)
+			die("write");
+		done += w;
+	}
+}
+
+// Anonymous temporary file (unlinked right away, freed on close)
+int temp_file(void) {
+	const char *dir = getenv("TMPDIR");
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/extsort.XXXXXX", dir ? dir : "/tmp");
+	int fd = mkstemp(path);
+	if (fd < 0)
+		die("mkstemp");
+	unlink(path);
+	return fd;
+}
+
+// One half of a double buffer; "ready" means filled (reads) or free (writes)
+typedef struct io_buf {
+	int *data;
+	long len, pos;
+	int ready;
+} io_buf;
+
+typedef struct io_request {
+	int fd;
+	int is_write;
+	io_buf *buf;
+	long cap;
+} io_request;
+
+// A single background thread performs all reads and writes in FIFO order,
+// so the merge keeps computing while the other half of each buffer moves
+typedef struct io_thread {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	io_request *queue;
+	long cap, head, tail;
+	int stop;
+} io_thread;
+
+void *io_loop(void *arg) {
+	io_thread *io = (io_thread *) arg;
+	pthread_mutex_lock(&io -> lock);
+	for (;;) {
+		while (io -> head == io -> tail && !io -> stop)
+			pthread_cond_wait(&io -> work, &io -> lock);
+		if (io -> head == io -> tail)
+			break;
+		io_request r = io -> queue[io -> head++ % io -> cap];
+		pthread_mutex_unlock(&io -> lock);
+
+		if (r.is_write)
+			write_full(r.fd, r.buf -> data, r.buf -> len * sizeof(int));
+		else
+			r.buf -> len = read_full(r.fd, r.buf -> data, r.cap * sizeof(int)) / sizeof(int);
+
+		pthread_mutex_lock(&io -> lock);
+		r.buf -> ready = 1;
+		pthread_cond_broadcast(&io -> done);
+	}
+	pthread_mutex_unlock(&io -> lock);
+	return NULL;
+}
+
+void io_start(io_thread *io, long max_requests) {
+	pthread_mutex_init(&io -> lock, NULL);
+	pthread_cond_init(&io -> work, NULL);
+	pthread_cond_init(&io -> done, NULL);
+	io -> cap = max_requests;
+	io -> queue = (io_request *) malloc(max_requests * sizeof(io_request));
+	io -> head = io -> tail = 0;
+	io -> stop = 0;
+	pthread_create(&io -> thread, NULL, io_loop, io);
+}
+
+void io_stop(io_thread *io) {
+	pthread_mutex_lock(&io -> lock);
+	io -> stop = 1;
+	pthread_cond_signal(&io -> work);
+	pthread_mutex_unlock(&io -> lock);
+	pthread_join(io -> thread, NULL);
+	pthread_mutex_destroy(&io -> lock);
+	pthread_cond_destroy(&io -> work);
+	pthread_cond_destroy(&io -> done);
+	free(io -> queue);
+}
+
+void io_submit(io_thread *io, int fd, int is_write, io_buf *buf, long cap) {
+	pthread_mutex_lock(&io -> lock);
+	buf -> ready = 0;
+	io -> queue[io -> tail++ % io -> cap] = (io_request) {fd, is_write, buf, cap};
+	pthread_cond_signal(&io -> work);
+	pthread_mutex_unlock(&io -> lock);
+}
+
+void io_wait(io_thread *io, io_buf *buf) {
+	pthread_mutex_lock(&io -> lock);
+	while (!buf -> ready)
+		pthread_cond_wait(&io -> done, &io -> lock);
+	pthread_mutex_unlock(&io -> lock);
+}
+
+// Sequential reader of one sorted run, double buffered
+typedef struct run_reader {
+	int fd;
+	io_buf buf[2];
+	int cur;
+	long cap;
+} run_reader;
+
+void reader_open(run_reader *r, io_thread *io, int fd, int *mem, long cap) {
+	r -> fd = fd;
+	r -> cap = cap;
+	r -> cur = 0;
+	for (int b = 0; b < 2; b++) {
+		r -> buf[b] = (io_buf) {mem + b * cap, 0, 0, 0};
+		io_submit(io, fd, 0, &r -> buf[b], cap);
+	}
+	io_wait(io, &r -> buf[0]);
+}
+
+// Next value of the run; returns 0 once the run is exhausted
+int reader_next(run_reader *r, io_thread *io, int *value) {
+	io_buf *b = &r -> buf[r -> cur];
+	if (b -> pos == b -> len) {
+		if (b -> len < r -> cap)
+			return 0;
+		// Refill this half in the background and switch to the other one
+		b -> pos = 0;
+		io_submit(io, r -> fd, 0, b, r -> cap);
+		r -> cur ^= 1;
+		b = &r -> buf[r -> cur];
+		io_wait(io, b);
+		b -> pos = 0;
+		if (b -> len == 0)
+			return 0;
+	}
+	*value = b -> data[b -> pos++];
+	return 1;
+}
+
+// Sequential writer, double buffered
+typedef struct run_writer {
+	int fd;
+	io_buf buf[2];
+	int cur;
+	long cap;
+} run_writer;
+
+void writer_open(run_writer *w, int fd, int *mem, long cap) {
+	w -> fd = fd;
+	w -> cap = cap;
+	w -> cur = 0;
+	for (int b = 0; b < 2; b++)
+		w -> buf[b] = (io_buf) {mem + b * cap, 0, 0, 1};
+}
+
+void writer_put(run_writer *w, io_thread *io, int value) {
+	io_buf *b = &w -> buf[w -> cur];
+	b -> data[b -> len++] = value;
+	if (b -> len == w -> cap) {
+		io_submit(io, w -> fd, 1, b, w -> cap);
+		w -> cur ^= 1;
+		b = &w -> buf[w -> cur];
+		io_wait(io, b);
+		b -> len = 0;
+	}
+}
+
+void writer_close(run_writer *w, io_thread *io) {
+	io_buf *b = &w -> buf[w -> cur];
+	if (b -> len)
+		io_submit(io, w -> fd, 1, b, w -> cap);
+	io_wait(io, &w -> buf[0]);
+	io_wait(io, &w -> buf[1]);
+}
+
+// Loser tree over k sources: tree[t] holds the loser of the match at
+// internal node t, tree[0] the overall winner. Exhausted sources carry
+// LLONG_MAX; key[k] = LLONG_MIN is a dummy used only while building.
+typedef struct loser_tree {
+	int k;
+	int *tree;
+	long long *key;
+} loser_tree;
+
+void lt_adjust(loser_tree *lt, int s) {
+	for (int t = (s + lt -> k) / 2; t > 0; t /= 2) {
+		if (lt -> key[lt -> tree[t]] < lt -> key[s]) {
+			int winner = lt -> tree[t];
+			lt -> tree[t] = s;
+			s = winner;
+		}
+	}
+	lt -> tree[0] = s;
+}
+
+void lt_build(loser_tree *lt) {
+	lt -> key[lt -> k] = LLONG_MIN;
+	for (int t = 0; t < lt -> k; t++)
+		lt -> tree[t] = lt -> k;
+	for (int s = lt -> k - 1; s >= 0; s--)
+		lt_adjust(lt, s);
+}
+
+// Merge runs[0..k) into out_fd using at most mem_ints ints of buffers
+void merge_runs(int *runs, int k, int out_fd, int *mem, long mem_ints) {
+	long cap = mem_ints / (2 * k + 2);
+	io_thread io;
+	run_reader *readers = (run_reader *) malloc(k * sizeof(run_reader));
+	run_writer writer;
+	loser_tree lt = {k, (int *) malloc(k * sizeof(int)),
+	                 (long long *) malloc((k + 1) * sizeof(long long))};
+
+	io_start(&io, 2 * k + 4);
+	for (int r = 0; r < k; r++) {
+		lseek(runs[r], 0, SEEK_SET);
+		reader_open(&readers[r], &io, runs[r], mem + 2 * r * cap, cap);
+	}
+	writer_open(&writer, out_fd, mem + 2 * k * cap, cap);
+
+	for (int r = 0; r < k; r++) {
+		int v;
+		lt.key[r] = reader_next(&readers[r], &io, &v) ? v : LLONG_MAX;
+	}
+	lt_build(&lt);
+
+	while (lt.key[lt.tree[0]] != LLONG_MAX) {
+		int w = lt.tree[0], v;
+		writer_put(&writer, &io, (int) lt.key[w]);
+		lt.key[w] = reader_next(&readers[w], &io, &v) ? v : LLONG_MAX;
+		lt_adjust(&lt, w);
+	}
+	writer_close(&writer, &io);
+	io_stop(&io);
+
+	free(readers);
+	free(lt.tree);
+	free(lt.key);
+}
+
+// Merge the last k runs of runs[0..*nruns) into one new run in their place
+void merge_top(int *runs, int *level, int *nruns, int k, int new_level, int *mem, long mem_ints) {
+	int first = *nruns - k;
+	int fd = temp_file();
+	merge_runs(runs + first, k, fd, mem, mem_ints);
+	for (int i = first; i < *nruns; i++)
+		close(runs[i]);
+	runs[first] = fd;
+	level[first] = new_level;
+	*nruns = first + 1;
+}
+
+// Sort the ints in in_path into out_path using about mem_bytes of memory:
+// sorted runs of mem_bytes / 9 ints (4 bytes of data and 4 of merge
+// buffer per int, plus slack for run bounds) are spilled to temporary
+// files and merged k ways. Runs are merged as soon as max_k of them share
+// a level (like carries in a base-max_k counter), so only a few times
+// max_k files are open at once however large the input is.
+void external_sort(const char *in_path, const char *out_path, long mem_bytes) {
+	int in = open(in_path, O_RDONLY);
+	if (in < 0)
+		die(in_path);
+	struct stat st;
+	if (fstat(in, &st) < 0)
+		die(in_path);
+	if (st.st_size % sizeof(int)) {
+		fprintf(stderr, "%s: size %lld is not a multiple of %zu bytes\n",
+		        in_path, (long long) st.st_size, sizeof(int));
+		exit(1);
+	}
+	int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0)
+		die(out_path);
+
+	// 4 bytes of data + 4 of merge buffer per int, plus slack for run bounds
+	long chunk = mem_bytes / 9;
+	if (chunk < MIN_IO_INTS)
+		chunk = MIN_IO_INTS;
+	int *mem = (int *) malloc(chunk * sizeof(int));
+	long mem_ints = chunk;
+
+	// Fan-in limited so each buffer is >= 64 KB, and so that four levels
+	// of pending runs fit in the descriptor limit
+	int max_k = (int) ((mem_ints / MIN_IO_INTS - 2) / 2);
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+	    (long) rl.rlim_cur / 4 - 8 < max_k)
+		max_k = (int) (rl.rlim_cur / 4) - 8;
+	if (max_k < 2)
+		max_k = 2;
+
+	// Pending runs, with levels non-increasing from bottom to top
+	int *runs = NULL, *level = NULL;
+	int nruns = 0, cap = 0;
+
+	for (;;) {
+		long n = read_full(in, mem, chunk * sizeof(int)) / sizeof(int);
+		if (n == 0)
+			break;
+		natural_merge_sort(mem, n);
+		int fd = temp_file();
+		write_full(fd, mem, n * sizeof(int));
+		if (nruns == cap) {
+			cap = cap ? 2 * cap : 64;
+			runs = (int *) realloc(runs, cap * sizeof(int));
+			level = (int *) realloc(level, cap * sizeof(int));
+		}
+		runs[nruns] = fd;
+		level[nruns++] = 0;
+
+		// Carry: max_k runs on the top level become one run a level up
+		while (nruns >= max_k && level[nruns - max_k] == level[nruns - 1])
+			merge_top(runs, level, &nruns, max_k, level[nruns - 1] + 1, mem, mem_ints);
+	}
+	close(in);
+
+	// Merge the smallest runs until one final max_k-way merge remains
+	while (nruns > max_k) {
+		int k = nruns - max_k + 1 < max_k ? nruns - max_k + 1 : max_k;
+		merge_top(runs, level, &nruns, k, level[nruns - k], mem, mem_ints);
+	}
+	if (nruns)
+		merge_runs(runs, nruns, out, mem, mem_ints);
+	for (int r = 0; r < nruns; r++)
+		close(runs[r]);
+
+	close(out);
+	free(runs);
+	free(level);
+	free(mem);
+}
+
+// SIMD merge sort: sorting networks for small blocks and bitonic merge
+// kernels, selected at runtime (AVX2, SSE4.1 or scalar)
+
+typedef enum simd_level {
+	SIMD_SCALAR,
+	SIMD_SSE4,
+	SIMD_AVX2
+} simd_level;
+
+const char *simd_names[] = {"scalar", "sse4.1", "avx2"};
+
+// Best level the running CPU supports
+simd_level simd_detect(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse4.1"))
+		return SIMD_SSE4;
+	return SIMD_SCALAR;
+}
 
-	merge_sort(arr, left, mid);
-	merge_sort(arr, mid + 1, right);
-	merge(arr, left, mid, right);
+// One comparator layer: every lane is compared with lane idx[i] and keeps
+// the max where bit i of mask is set, the min otherwise
+#define LAYER8(v, i0, i1, i2, i3, i4, i5, i6, i7, mask) do { \
+	__m256i p_ = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(i0, i1, i2, i3, i4, i5, i6, i7)); \
+	v = _mm256_blend_epi32(_mm256_min_epi32(v, p_), _mm256_max_epi32(v, p_), mask); \
+} while (0)
+
+#define LAYER4(v, shuffle, mask) do { \
+	__m128i p_ = _mm_shuffle_epi32(v, shuffle); \
+	v = _mm_castps_si128(_mm_blend_ps(_mm_castsi128_ps(_mm_min_epi32(v, p_)), \
+	                                  _mm_castsi128_ps(_mm_max_epi32(v, p_)), mask)); \
+} while (0)
+
+// Bitonic sorting network for 8 ints in one register (6 layers)
+__attribute__((target("avx2")))
+__m256i sort8_avx2(__m256i v) {
+	LAYER8(v, 1, 0, 3, 2, 5, 4, 7, 6, 0x66);
+	LAYER8(v, 2, 3, 0, 1, 6, 7, 4, 5, 0x3C);
+	LAYER8(v, 1, 0, 3, 2, 5, 4, 7, 6, 0x5A);
+	LAYER8(v, 4, 5, 6, 7, 0, 1, 2, 3, 0xF0);
+	LAYER8(v, 2, 3, 0, 1, 6, 7, 4, 5, 0xCC);
+	LAYER8(v, 1, 0, 3, 2, 5, 4, 7, 6, 0xAA);
+	return v;
+}
+
+// Sorts a bitonic sequence of 8 ints
+__attribute__((target("avx2")))
+__m256i bitonic_clean8_avx2(__m256i v) {
+	LAYER8(v, 4, 5, 6, 7, 0, 1, 2, 3, 0xF0);
+	LAYER8(v, 2, 3, 0, 1, 6, 7, 4, 5, 0xCC);
+	LAYER8(v, 1, 0, 3, 2, 5, 4, 7, 6, 0xAA);
+	return v;
+}
+
+// Merge two sorted vectors: *lo gets the 8 smallest, *hi the 8 largest
+__attribute__((target("avx2")))
+void bitonic_merge8_avx2(__m256i a, __m256i b, __m256i *lo, __m256i *hi) {
+	b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+	*lo = bitonic_clean8_avx2(_mm256_min_epi32(a, b));
+	*hi = bitonic_clean8_avx2(_mm256_max_epi32(a, b));
+}
+
+__attribute__((target("sse4.1")))
+__m128i sort4_sse4(__m128i v) {
+	LAYER4(v, _MM_SHUFFLE(2, 3, 0, 1), 0x6);
+	LAYER4(v, _MM_SHUFFLE(1, 0, 3, 2), 0xC);
+	LAYER4(v, _MM_SHUFFLE(2, 3, 0, 1), 0xA);
+	return v;
+}
+
+__attribute__((target("sse4.1")))
+__m128i bitonic_clean4_sse4(__m128i v) {
+	LAYER4(v, _MM_SHUFFLE(1, 0, 3, 2), 0xC);
+	LAYER4(v, _MM_SHUFFLE(2, 3, 0, 1), 0xA);
+	return v;
+}
+
+__attribute__((target("sse4.1")))
+void bitonic_merge4_sse4(__m128i a, __m128i b, __m128i *lo, __m128i *hi) {
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3));
+	*lo = bitonic_clean4_sse4(_mm_min_epi32(a, b));
+	*hi = bitonic_clean4_sse4(_mm_max_epi32(a, b));
 }
 
-int main() {
+// Branch-free scalar merge, also used for the tails of the vector merges
+void merge_scalar(const int *a, long na, const int *b, long nb, int *out) {
+	long i = 0, j = 0, k = 0;
+	while (i < na && j < nb) {
+		int take_b = b[j] < a[i];
+		out[k++] = take_b ? b[j] : a[i];
+		j += take_b;
+		i += !take_b;
+	}
+	memcpy(out + k, a + i, (na - i) * sizeof(int));
+	k += na - i;
+	memcpy(out + k, b + j, (nb - j) * sizeof(int));
+}
+
+// Finish a vector merge: carry[0..w) is sorted and every element already
+// written is <= all of carry, a-tail and b-tail
+void merge_tail(const int *carry, int w, const int *a, long na,
+                const int *b, long nb, int *out) {
+	long i = 0, j = 0, k = 0;
+	int c = 0;
+
+	// Three-way merge until the carry is used up, then a plain merge
+	while (c < w) {
+		int best = carry[c], from = 0;
+		if (i < na && a[i] < best) {
+			best = a[i];
+			from = 1;
+		}
+		if (j < nb && b[j] < best) {
+			best = b[j];
+			from = 2;
+		}
+		out[k++] = best;
+		c += from == 0;
+		i += from == 1;
+		j += from == 2;
+	}
+	merge_scalar(a + i, na - i, b + j, nb - j, out + k);
+}
+
+// Merge with 8-wide bitonic kernels: keep the upper half of every 16-way
+// merge in a register and feed it the next vector from the run whose head
+// is smaller
+__attribute__((target("avx2")))
+void merge_avx2(const int *a, long na, const int *b, long nb, int *out) {
+	if (na < 8 || nb < 8) {
+		merge_scalar(a, na, b, nb, out);
+		return;
+	}
+	__m256i lo, hi;
+	bitonic_merge8_avx2(_mm256_loadu_si256((const __m256i *) a),
+	                    _mm256_loadu_si256((const __m256i *) b), &lo, &hi);
+	_mm256_storeu_si256((__m256i *) out, lo);
+	long i = 8, j = 8, k = 8;
+
+	while (i + 8 <= na && j + 8 <= nb) {
+		__m256i next;
+		if (a[i] <= b[j]) {
+			next = _mm256_loadu_si256((const __m256i *) (a + i));
+			i += 8;
+		} else {
+			next = _mm256_loadu_si256((const __m256i *) (b + j));
+			j += 8;
+		}
+		bitonic_merge8_avx2(next, hi, &lo, &hi);
+		_mm256_storeu_si256((__m256i *) (out + k), lo);
+		k += 8;
+	}
+
+	int carry[8];
+	_mm256_storeu_si256((__m256i *) carry, hi);
+	merge_tail(carry, 8, a + i, na - i, b + j, nb - j, out + k);
+}
+
+__attribute__((target("sse4.1")))
+void merge_sse4(const int *a, long na, const int *b, long nb, int *out) {
+	if (na < 4 || nb < 4) {
+		merge_scalar(a, na, b, nb, out);
+		return;
+	}
+	__m128i lo, hi;
+	bitonic_merge4_sse4(_mm_loadu_si128((const __m128i *) a),
+	                    _mm_loadu_si128((const __m128i *) b), &lo, &hi);
+	_mm_storeu_si128((__m128i *) out, lo);
+	long i = 4, j = 4, k = 4;
+
+	while (i + 4 <= na && j + 4 <= nb) {
+		__m128i next;
+		if (a[i] <= b[j]) {
+			next = _mm_loadu_si128((const __m128i *) (a + i));
+			i += 4;
+		} else {
+			next = _mm_loadu_si128((const __m128i *) (b + j));
+			j += 4;
+		}
+		bitonic_merge4_sse4(next, hi, &lo, &hi);
+		_mm_storeu_si128((__m128i *) (out + k), lo);
+		k += 4;
+	}
+
+	int carry[4];
+	_mm_storeu_si128((__m128i *) carry, hi);
+	merge_tail(carry, 4, a + i, na - i, b + j, nb - j, out + k);
+}
+
+// Sort every full block of 8 (or 4) with the in-register network; the
+// final partial block, and everything in scalar mode, uses insertion sort
+__attribute__((target("avx2")))
+void sort_blocks_avx2(int *arr, long n) {
+	long i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (arr + i));
+		_mm256_storeu_si256((__m256i *) (arr + i), sort8_avx2(v));
+	}
+	insertion_sort(arr + i, n - i);
+}
+
+__attribute__((target("sse4.1")))
+void sort_blocks_sse4(int *arr, long n) {
+	long i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (arr + i));
+		_mm_storeu_si128((__m128i *) (arr + i), sort4_sse4(v));
+	}
+	insertion_sort(arr + i, n - i);
+}
+
+// Bottom-up merge sort using the kernels of the given level: sorted blocks
+// of the vector width, then merge passes ping-ponging with one buffer
+void simd_merge_sort(int *arr, long n, simd_level level) {
+	void (*merge_fn)(const int *, long, const int *, long, int *) = merge_scalar;
+	long width = 8;
+
+	if (level == SIMD_AVX2) {
+		sort_blocks_avx2(arr, n);
+		merge_fn = merge_avx2;
+	} else if (level == SIMD_SSE4) {
+		sort_blocks_sse4(arr, n);
+		merge_fn = merge_sse4;
+		width = 4;
+	} else {
+		for (long i = 0; i < n; i += width)
+			insertion_sort(arr + i, n - i < width ? n - i : width);
+	}
+	if (n <= width)
+		return;
+
+	int *tmp = (int *) malloc(n * sizeof(int));
+	int *src = arr, *dst = tmp;
+
+	for (; width < n; width *= 2) {
+		for (long lo = 0; lo < n; lo += 2 * width) {
+			long mid = lo + width < n ? lo + width : n;
+			long hi = lo + 2 * width < n ? lo + 2 * width : n;
+			merge_fn(src + lo, mid - lo, src + mid, hi - mid, dst + lo);
+		}
+		int *t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != arr)
+		memcpy(arr, src, n * sizeof(int));
+	free(tmp);
+}
+
+// Time the natural merge sort against the top-down sort on input shapes
+// from random to nearly sorted
+int bench_natural(long n) {
+	const char *shapes[] = {"random", "sorted", "reversed", "nearly sorted", "few runs"};
+	int *input = (int *) malloc(n * sizeof(int));
+	int *a = (int *) malloc(n * sizeof(int));
+	int *b = (int *) malloc(n * sizeof(int));
+
+	printf("%ld ints\n", n);
+	for (int shape = 0; shape < 5; shape++) {
+		uint64_t seed = 42;
+		for (long i = 0; i < n; i++) {
+			switch (shape) {
+			case 0: input[i] = (int) bench_rand(&seed); break;
+			case 1: case 3: input[i] = (int) i; break;
+			case 2: input[i] = (int) (n - i); break;
+			case 4: input[i] = (int) (i % (n / 8 + 1)); break;
+			}
+		}
+		// nearly sorted: swap 0.1% of the elements with a random partner
+		if (shape == 3) {
+			for (long s = 0; s < n / 1000; s++) {
+				long x = bench_rand(&seed) % n, y = bench_rand(&seed) % n;
+				int t = input[x];
+				input[x] = input[y];
+				input[y] = t;
+			}
+		}
+
+		memcpy(a, input, n * sizeof(int));
+		double t = now_sec();
+		parallel_merge_sort(a, n, 1);
+		double top_down = now_sec() - t;
+
+		memcpy(b, input, n * sizeof(int));
+		t = now_sec();
+		natural_merge_sort(b, n);
+		double natural = now_sec() - t;
+
+		printf("%-13s: top-down %.3f s, natural %.3f s (%.1fx)%s\n", shapes[shape],
+		       top_down, natural, top_down / natural,
+		       memcmp(a, b, n * sizeof(int)) ? "  WRONG OUTPUT" : "");
+	}
+
+	free(input);
+	free(a);
+	free(b);
+	return 0;
+}
+
+// Speedup of the parallel sort over 1, 2, 4, ... threads on n random ints
+int bench_parallel(long n, int max_threads) {
+	int *input = (int *) malloc(n * sizeof(int));
+	int *arr = (int *) malloc(n * sizeof(int));
+	int *expect = (int *) malloc(n * sizeof(int));
+	uint64_t seed = 42;
+	double base = 0;
+
+	for (long i = 0; i < n; i++)
+		input[i] = (int) bench_rand(&seed);
+
+	printf("%ld ints, %ld online cores\n", n, sysconf(_SC_NPROCESSORS_ONLN));
+	for (int t = 1; t <= max_threads; t *= 2) {
+		memcpy(arr, input, n * sizeof(int));
+		double start = now_sec();
+		parallel_merge_sort(arr, n, t);
+		double elapsed = now_sec() - start;
+
+		if (t == 1) {
+			base = elapsed;
+			memcpy(expect, arr, n * sizeof(int));
+		}
+		int ok = !memcmp(arr, expect, n * sizeof(int));
+		for (long i = 1; ok && i < n; i++)
+			ok = arr[i - 1] <= arr[i];
+
+		printf("%2d threads: %.3f s, speedup %.2fx%s\n", t, elapsed, base / elapsed,
+		       ok ? "" : "  WRONG OUTPUT");
+	}
+
+	free(input);
+	free(arr);
+	free(expect);
+	return 0;
+}
+
+// Generate size_mb of random ints, sort them externally under a mem_mb
+// cap, check the output and report throughput and peak RSS
+int bench_external(long size_mb, long mem_mb) {
+	char in_path[] = "/tmp/extsort_in.XXXXXX";
+	char out_path[] = "/tmp/extsort_out.XXXXXX";
+	int in = mkstemp(in_path), out = mkstemp(out_path);
+	if (in < 0 || out < 0)
+		die("mkstemp");
+	close(out);
+
+	long n = size_mb * 1024 * 1024 / sizeof(int);
+	int block[1 << 14];
+	uint64_t seed = 42, sum = 0;
+	for (long done = 0; done < n; ) {
+		long len = n - done < (1 << 14) ? n - done : (1 << 14);
+		for (long i = 0; i < len; i++) {
+			block[i] = (int) bench_rand(&seed);
+			sum += block[i];
+		}
+		write_full(in, block, len * sizeof(int));
+		done += len;
+	}
+	close(in);
+
+	double t = now_sec();
+	external_sort(in_path, out_path, mem_mb * 1024 * 1024);
+	double elapsed = now_sec() - t;
+
+	// Verify: sorted, same length, same sum
+	int fd = open(out_path, O_RDONLY);
+	long count = 0, len;
+	int prev = INT_MIN, ok = 1;
+	uint64_t check = 0;
+	while ((len = read_full(fd, block, sizeof(block)) / sizeof(int)) > 0) {
+		for (long i = 0; i < len; i++) {
+			ok &= block[i] >= prev;
+			prev = block[i];
+			check += block[i];
+		}
+		count += len;
+	}
+	close(fd);
+	unlink(in_path);
+	unlink(out_path);
+
+	printf("%ld MB under a %ld MB cap: %.2f s, %.1f MB/s, peak RSS %.1f MB%s\n",
+	       size_mb, mem_mb, elapsed, size_mb / elapsed, peak_rss_kb() / 1024.0,
+	       ok && count == n && check == sum ? "" : "  WRONG OUTPUT");
+	return 0;
+}
+
+// Check every available SIMD level against the scalar path and time
+// them on random, sorted and duplicate-heavy input
+int bench_simd(long n) {
+	const char *shapes[] = {"random", "sorted", "duplicates"};
+	simd_level best = simd_detect();
+	int *input = (int *) malloc(n * sizeof(int));
+	int *expect = (int *) malloc(n * sizeof(int));
+	int *arr = (int *) malloc(n * sizeof(int));
+
+	printf("%ld ints, best level: %s\n", n, simd_names[best]);
+	for (int shape = 0; shape < 3; shape++) {
+		uint64_t seed = 42;
+		for (long i = 0; i < n; i++) {
+			if (shape == 0)
+				input[i] = (int) bench_rand(&seed);
+			else if (shape == 1)
+				input[i] = (int) i;
+			else
+				input[i] = (int) (bench_rand(&seed) % 16);
+		}
+
+		memcpy(expect, input, n * sizeof(int));
+		double t = now_sec();
+		parallel_merge_sort(expect, n, 1);
+		printf("%-10s: top-down %.3f s", shapes[shape], now_sec() - t);
+
+		for (int level = SIMD_SCALAR; level <= (int) best; level++) {
+			memcpy(arr, input, n * sizeof(int));
+			t = now_sec();
+			simd_merge_sort(arr, n, (simd_level) level);
+			printf(", %s %.3f s%s", simd_names[level], now_sec() - t,
+			       memcmp(arr, expect, n * sizeof(int)) ? " (WRONG OUTPUT)" : "");
+		}
+		printf("\n");
+	}
+
+	free(input);
+	free(expect);
+	free(arr);
+	return 0;
+}
+
+// bench parallel [n] [max threads] | bench natural [n] | bench simd [n] |
+// bench external [size MB] [memory MB]
+int bench(int argc, char **argv) {
+	const char *mode = argc > 2 ? argv[2] : "parallel";
+	long n = argc > 3 ? atol(argv[3]) : 100000000;
+
+	if (!strcmp(mode, "parallel"))
+		return bench_parallel(n, argc > 4 ? atoi(argv[4]) : (int) sysconf(_SC_NPROCESSORS_ONLN));
+	if (!strcmp(mode, "natural"))
+		return bench_natural(n);
+	if (!strcmp(mode, "simd"))
+		return bench_simd(n);
+	if (!strcmp(mode, "external"))
+		return bench_external(argc > 3 ? n : 1024, argc > 4 ? atol(argv[4]) : 64);
+
+	fprintf(stderr, "unknown bench mode: %s\n", mode);
+	return 1;
+}
+
+// Build with -pthread (and -DNDEBUG for benchmarks). "external <in>
+// <out> [memory MB]" sorts a binary int file; without arguments the
+// traced demo runs.
+int main(int argc, char **argv) {
+	if (argc > 1 && !strcmp(argv[1], "bench"))
+		return bench(argc, argv);
+	if (argc > 3 && !strcmp(argv[1], "external")) {
+		external_sort(argv[2], argv[3], (argc > 4 ? atol(argv[4]) : 256) * 1024 * 1024);
+		return 0;
+	}
+
 	int arr[20] = {42, 17, 8, 33, 91, 56, 23, 11, 77, 19,
 	               60, 4, 85, 31, 28, 90, 47, 64, 12, 39};
 	int n = 20;
@@ -65,7 +1367,8 @@ int main() {
 	print_array(arr, n);
 	printf("\n");
 
-	merge_sort(arr, 0, n - 1);
+	int tmp[(20 + 1) / 2];
+	merge_sort(arr, tmp, 0, n - 1);
 
 	printf("\nSorted Array:\n");
 	print_array(arr, n);
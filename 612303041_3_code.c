@@ -1,13 +1,134 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "pool.h"
+#include "bench.h"
 
+// Keys are interned strings of any length. The first 8 bytes are also
+// kept inline as a big-endian integer, so most comparisons are a single
+// integer compare that never touches the string.
 typedef struct node {
-	char month[20];
+	uint64_t prefix;
+	const char *key;
 	int height;
 	struct node *left, *right;
 } node;
 
+// All AVL nodes come from this pool
+static pool node_pool = POOL_INIT(node);
+
+#define INTERN_BLOCK (1 << 20)   // string storage is carved from 1 MB blocks
+
+// String interning table: open addressing over pointers into a string
+// arena. Interned strings live until intern_clear.
+typedef struct intern_table {
+	const char **slots;
+	uint32_t *hashes;
+	size_t cap, count;
+	char *cursor, *end;     // free tail of the newest block
+	char **blocks;          // every block, for intern_clear
+	size_t nblocks;
+} intern_table;
+
+static intern_table strings;
+
+uint32_t hash_string(const char *s, size_t len) {
+	uint32_t h = 2166136261u;
+	for(size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char) s[i]) * 16777619u;
+	return h;
+}
+
+// Copy a string into the arena
+char *intern_copy(intern_table *t, const char *s, size_t len) {
+	if((size_t) (t -> end - t -> cursor) < len + 1) {
+		size_t size = len + 1 > INTERN_BLOCK ? len + 1 : INTERN_BLOCK;
+		t -> blocks = (char **) realloc(t -> blocks, (t -> nblocks + 1) * sizeof(char *));
+		t -> cursor = t -> blocks[t -> nblocks++] = (char *) malloc(size);
+		t -> end = t -> cursor + size;
+	}
+	char *copy = t -> cursor;
+	memcpy(copy, s, len + 1);
+	t -> cursor += len + 1;
+	return copy;
+}
+
+void intern_grow(intern_table *t) {
+	size_t cap = t -> cap ? 2 * t -> cap : 1024;
+	const char **slots = (const char **) calloc(cap, sizeof(char *));
+	uint32_t *hashes = (uint32_t *) malloc(cap * sizeof(uint32_t));
+
+	for(size_t i = 0; i < t -> cap; i++) {
+		if(!t -> slots[i])
+			continue;
+		size_t j = t -> hashes[i] & (cap - 1);
+		while(slots[j])
+			j = (j + 1) & (cap - 1);
+		slots[j] = t -> slots[i];
+		hashes[j] = t -> hashes[i];
+	}
+	free(t -> slots);
+	free(t -> hashes);
+	t -> slots = slots;
+	t -> hashes = hashes;
+	t -> cap = cap;
+}
+
+// Return the canonical copy of s: equal strings always get the same pointer
+const char *intern(const char *s) {
+	intern_table *t = &strings;
+	if(2 * (t -> count + 1) > t -> cap)
+		intern_grow(t);
+
+	size_t len = strlen(s);
+	uint32_t h = hash_string(s, len);
+	size_t i = h & (t -> cap - 1);
+	while(t -> slots[i]) {
+		if(t -> hashes[i] == h && !strcmp(t -> slots[i], s))
+			return t -> slots[i];
+		i = (i + 1) & (t -> cap - 1);
+	}
+	t -> slots[i] = intern_copy(t, s, len);
+	t -> hashes[i] = h;
+	t -> count++;
+	return t -> slots[i];
+}
+
+void intern_clear(void) {
+	intern_table *t = &strings;
+	for(size_t i = 0; i < t -> nblocks; i++)
+		free(t -> blocks[i]);
+	free(t -> blocks);
+	free(t -> slots);
+	free(t -> hashes);
+	memset(t, 0, sizeof(*t));
+}
+
+// First 8 bytes of key as a big-endian integer, zero padded, so integer
+// order matches strcmp order on those bytes
+uint64_t key_prefix(const char *key) {
+	uint64_t p = 0;
+	int i = 0;
+	for(; i < 8 && key[i]; i++)
+		p = (p << 8) | (unsigned char) key[i];
+	return p << (8 * (8 - i));
+}
+
+// Three-way compare of (prefix, key) with a node's key. Equal prefixes
+// whose last byte is 0 mean both keys are shorter than 8 bytes and equal;
+// only keys sharing a full 8-byte prefix fall back to strcmp.
+int compare_key(uint64_t prefix, const char *key, const node *n) {
+	if(prefix != n -> prefix)
+		return prefix < n -> prefix ? -1 : 1;
+	if(key == n -> key || !(prefix & 0xFF))
+		return 0;
+	return strcmp(key + 8, n -> key + 8);
+}
+
 int max(int a, int b) {
 	return a > b ? a : b;
 }
@@ -17,10 +138,11 @@ int height(node *n) {
 	return n ? n -> height : 0;
 }
 
-// Create a new AVL node
-node *create_node(const char *month) {
-	node *n = (node *) malloc(sizeof(node));
-	strcpy(n -> month, month);
+// Create a new AVL node for an interned key
+node *create_node(uint64_t prefix, const char *key) {
+	node *n = (node *) pool_alloc(&node_pool);
+	n -> prefix = prefix;
+	n -> key = key;
 	n -> left = n -> right = NULL;
 	n -> height = 1;
 	return n;
@@ -61,15 +183,17 @@ int get_balance(node *n) {
 	return height(n -> left) - height(n -> right);
 }
 
-// Insert a month into the AVL tree
-node *insert_node(node *root, const char *month) {
+// Insert below root; each level does one three-way compare, and the
+// rotation case is read from the child's balance instead of re-comparing
+node *insert_key(node *root, uint64_t prefix, const char *key) {
 	if(!root)
-		return create_node(month);
+		return create_node(prefix, key);
 
-	if(strcmp(month, root -> month) < 0)
-		root -> left = insert_node(root -> left, month);
-	else if(strcmp(month, root -> month) > 0)
-		root -> right = insert_node(root -> right, month);
+	int cmp = compare_key(prefix, key, root);
+	if(cmp < 0)
+		root -> left = insert_key(root -> left, prefix, key);
+	else if(cmp > 0)
+		root -> right = insert_key(root -> right, prefix, key);
 	else
 		// duplicates not allowed
 		return root;
@@ -78,29 +202,43 @@ node *insert_node(node *root, const char *month) {
 
 	int balance = get_balance(root);
 
-	// Left Left
-	if(balance > 1 && strcmp(month, root -> left -> month) < 0)
-		return right_rotate(root);
-
-	// Right Right
-	if(balance < -1 && strcmp(month, root -> right -> month) > 0)
-		return left_rotate(root);
-
-	// Left Right
-	if(balance > 1 && strcmp(month, root -> left -> month) > 0) {
-		root -> left = left_rotate(root -> left);
+	if(balance > 1) {
+		// Left Right
+		if(get_balance(root -> left) < 0)
+			root -> left = left_rotate(root -> left);
+		// Left Left
 		return right_rotate(root);
 	}
 
-	// Right Left
-	if(balance < -1 && strcmp(month, root -> right -> month) < 0) {
-		root -> right = right_rotate(root -> right);
+	if(balance < -1) {
+		// Right Left
+		if(get_balance(root -> right) > 0)
+			root -> right = right_rotate(root -> right);
+		// Right Right
 		return left_rotate(root);
 	}
 
 	return root;
 }
 
+// Insert a string key into the AVL tree
+node *insert_node(node *root, const char *key) {
+	const char *k = intern(key);
+	return insert_key(root, key_prefix(k), k);
+}
+
+// Find the node holding key (which need not be interned)
+node *search_node(node *root, const char *key) {
+	uint64_t prefix = key_prefix(key);
+	while(root) {
+		int cmp = compare_key(prefix, key, root);
+		if(!cmp)
+			return root;
+		root = cmp < 0 ? root -> left : root -> right;
+	}
+	return NULL;
+}
+
 // Print tree structure with indentation
 void display_tree(node *root, int space) {
 	if(!root)
@@ -111,7 +249,7 @@ void display_tree(node *root, int space) {
 	for(int i = 10; i < space; i++) {
 		printf(" ");
 	}
-	printf("%s\n", root -> month);
+	printf("%s\n", root -> key);
 	display_tree(root -> left, space);
 }
 
@@ -120,7 +258,7 @@ void inorder(node *root) {
 	if(!root)
 		return;
 	inorder(root -> left);
-	printf("%s ", root -> month);
+	printf("%s ", root -> key);
 	inorder(root -> right);
 }
 
@@ -129,10 +267,393 @@ void free_tree(node *root) {
 		return;
 	free_tree(root -> left);
 	free_tree(root -> right);
-	free(root);
+	pool_free(&node_pool, root);
+}
+
+// Persistent (path-copying) AVL tree. An insert copies the nodes on the
+// search path and returns a new root; every older root still describes
+// its own version. One writer publishes roots atomically; readers never
+// lock. Replaced nodes are freed by epoch-based reclamation once no reader
+// can still be inside a version that contains them.
+
+#define MAX_READERS 64
+#define EPOCH_IDLE ULONG_MAX
+
+// One slot per reader thread, padded to its own cache line
+typedef struct reader_slot {
+	atomic_ulong epoch;    // epoch the reader entered in, or EPOCH_IDLE
+	char pad[64 - sizeof(atomic_ulong)];
+} reader_slot;
+
+// Nodes retired during one epoch
+typedef struct limbo_list {
+	node **items;
+	size_t count, cap;
+} limbo_list;
+
+typedef struct persistent_avl {
+	_Atomic(node *) root;
+	atomic_ulong epoch;
+	reader_slot readers[MAX_READERS];
+	atomic_int nreaders;
+	limbo_list limbo[3];   // retired in epoch e lives in limbo[e % 3]
+} persistent_avl;
+
+void pavl_init(persistent_avl *t) {
+	atomic_init(&t -> root, NULL);
+	atomic_init(&t -> epoch, 0);
+	atomic_init(&t -> nreaders, 0);
+	for(int i = 0; i < MAX_READERS; i++)
+		atomic_init(&t -> readers[i].epoch, EPOCH_IDLE);
+	memset(t -> limbo, 0, sizeof(t -> limbo));
+}
+
+// Claim a reader slot; each reader thread calls this once
+int pavl_register_reader(persistent_avl *t) {
+	int slot = atomic_fetch_add(&t -> nreaders, 1);
+	if(slot >= MAX_READERS) {
+		fprintf(stderr, "pavl: more than %d readers\n", MAX_READERS);
+		exit(1);
+	}
+	return slot;
+}
+
+// Enter a read section and return the current version. The nodes
+// reachable from it stay valid until pavl_read_end.
+node *pavl_read_begin(persistent_avl *t, int slot) {
+	atomic_store(&t -> readers[slot].epoch, atomic_load(&t -> epoch));
+	return atomic_load(&t -> root);
+}
+
+void pavl_read_end(persistent_avl *t, int slot) {
+	atomic_store_explicit(&t -> readers[slot].epoch, EPOCH_IDLE, memory_order_release);
+}
+
+void retire(limbo_list *l, node *n) {
+	if(l -> count == l -> cap) {
+		l -> cap = l -> cap ? 2 * l -> cap : 256;
+		l -> items = (node **) realloc(l -> items, l -> cap * sizeof(node *));
+	}
+	l -> items[l -> count++] = n;
+}
+
+void free_limbo(limbo_list *l) {
+	for(size_t i = 0; i < l -> count; i++)
+		pool_free(&node_pool, l -> items[i]);
+	l -> count = 0;
+}
+
+// Advance the epoch if every active reader has caught up with it; nodes
+// retired two epochs ago can then no longer be reached by anyone
+void try_advance(persistent_avl *t) {
+	unsigned long e = atomic_load(&t -> epoch);
+	int n = atomic_load(&t -> nreaders);
+	for(int i = 0; i < n; i++) {
+		unsigned long r = atomic_load(&t -> readers[i].epoch);
+		if(r != EPOCH_IDLE && r != e)
+			return;
+	}
+	atomic_store(&t -> epoch, e + 1);
+	free_limbo(&t -> limbo[(e + 2) % 3]);
+}
+
+node *clone_node(node *n) {
+	node *c = (node *) pool_alloc(&node_pool);
+	*c = *n;
+	return c;
+}
+
+// Path-copying insert: the nodes along the path are cloned (the originals
+// are retired), so rotations only ever touch fresh copies
+node *persistent_insert_key(node *root, uint64_t prefix, const char *key, limbo_list *retired) {
+	if(!root)
+		return create_node(prefix, key);
+
+	int cmp = compare_key(prefix, key, root);
+	if(!cmp)
+		return root;
+
+	node *old_child = cmp < 0 ? root -> left : root -> right;
+	node *child = persistent_insert_key(old_child, prefix, key, retired);
+	if(child == old_child)
+		// duplicate further down: nothing changed
+		return root;
+
+	node *copy = clone_node(root);
+	retire(retired, root);
+	if(cmp < 0)
+		copy -> left = child;
+	else
+		copy -> right = child;
+
+	copy -> height = 1 + max(height(copy -> left), height(copy -> right));
+
+	int balance = get_balance(copy);
+	if(balance > 1) {
+		if(get_balance(copy -> left) < 0)
+			copy -> left = left_rotate(copy -> left);
+		return right_rotate(copy);
+	}
+	if(balance < -1) {
+		if(get_balance(copy -> right) > 0)
+			copy -> right = right_rotate(copy -> right);
+		return left_rotate(copy);
+	}
+	return copy;
+}
+
+// Writer: insert key and publish the new version
+void pavl_insert(persistent_avl *t, const char *key) {
+	const char *k = intern(key);
+	node *old_root = atomic_load_explicit(&t -> root, memory_order_relaxed);
+	limbo_list *retired = &t -> limbo[atomic_load(&t -> epoch) % 3];
+
+	node *new_root = persistent_insert_key(old_root, key_prefix(k), k, retired);
+	if(new_root != old_root)
+		atomic_store(&t -> root, new_root);
+	try_advance(t);
+}
+
+// Free every version; no reader may be active
+void pavl_destroy(persistent_avl *t) {
+	for(int i = 0; i < 3; i++) {
+		free_limbo(&t -> limbo[i]);
+		free(t -> limbo[i].items);
+	}
+	free_tree(atomic_load(&t -> root));
+	atomic_store(&t -> root, NULL);
 }
 
-int main() {
+// Path- and identifier-like keys: long shared prefixes, like real ones
+void make_key(char *buf, size_t size, uint64_t *seed) {
+	static const char *dirs[] = {"usr", "lib", "src", "include", "home", "var", "opt",
+	                             "share", "local", "drivers", "net", "kernel", "fs", "tests"};
+	static const char *words[] = {"get", "set", "user", "config", "buffer", "node", "tree",
+	                              "cache", "read", "write", "init", "free", "parse", "hash"};
+	uint64_t r = bench_rand(seed);
+
+	if(r & 1) {
+		// /usr/src/net/cache_1234.c
+		int len = 0, depth = 2 + (r >> 1) % 4;
+		for(int i = 0; i < depth; i++)
+			len += snprintf(buf + len, size - len, "/%s", dirs[bench_rand(seed) % 14]);
+		snprintf(buf + len, size - len, "/%s_%u.c", words[(r >> 8) % 14], (unsigned) (r >> 40) % 100000);
+	} else {
+		// get_user_cache_by_id_1234
+		snprintf(buf, size, "%s_%s_%s_%u", words[(r >> 1) % 14], words[(r >> 8) % 14],
+		         words[(r >> 16) % 14], (unsigned) (r >> 40) % 100000);
+	}
+}
+
+// Lookup that ignores the inline prefix (what every level used to do)
+node *search_node_strcmp(node *root, const char *key) {
+	while(root) {
+		int cmp = strcmp(key, root -> key);
+		if(!cmp)
+			return root;
+		root = cmp < 0 ? root -> left : root -> right;
+	}
+	return NULL;
+}
+
+// Load up to n keys (one per line from path, or synthetic ones) back to
+// back into *text; (*offsets)[i] is where key i starts. Returns the count.
+long load_keys(long n, const char *path, char **text, size_t **offsets) {
+	size_t size = 0, cap = 1 << 20;
+	long count = 0;
+	char line[4096];
+	FILE *f = NULL;
+	uint64_t seed = 42;
+
+	*text = (char *) malloc(cap);
+	*offsets = (size_t *) malloc(n * sizeof(size_t));
+	if(path && !(f = fopen(path, "r"))) {
+		perror(path);
+		exit(1);
+	}
+	while(count < n) {
+		if(f) {
+			if(!fgets(line, sizeof(line), f))
+				break;
+			line[strcspn(line, "\n")] = '\0';
+		} else {
+			make_key(line, sizeof(line), &seed);
+		}
+		size_t len = strlen(line) + 1;
+		if(size + len > cap) {
+			cap *= 2;
+			*text = (char *) realloc(*text, cap);
+		}
+		memcpy(*text + size, line, len);
+		(*offsets)[count++] = size;
+		size += len;
+	}
+	if(f)
+		fclose(f);
+	return count;
+}
+
+// Insert and look up n keys (one per line from path, or synthetic ones)
+int bench(long n, const char *path) {
+	char *text;
+	size_t *offsets;
+	long count = load_keys(n, path, &text, &offsets);
+
+	node *root = NULL;
+	double t = now_sec();
+	for(long i = 0; i < count; i++)
+		root = insert_node(root, text + offsets[i]);
+	double insert_time = now_sec() - t;
+
+	long found = 0, found_strcmp = 0;
+	t = now_sec();
+	for(long i = 0; i < count; i++)
+		found += search_node(root, text + offsets[i]) != NULL;
+	double lookup_time = now_sec() - t;
+
+	t = now_sec();
+	for(long i = 0; i < count; i++)
+		found_strcmp += search_node_strcmp(root, text + offsets[i]) != NULL;
+	double strcmp_time = now_sec() - t;
+
+	// How many comparisons the inline prefix settles on its own
+	long compares = 0, by_prefix = 0;
+	for(long i = 0; i < count; i += 16) {
+		const char *k = text + offsets[i];
+		uint64_t prefix = key_prefix(k);
+		for(node *x = root; x; ) {
+			compares++;
+			by_prefix += prefix != x -> prefix || !(prefix & 0xFF);
+			int cmp = compare_key(prefix, k, x);
+			if(!cmp)
+				break;
+			x = cmp < 0 ? x -> left : x -> right;
+		}
+	}
+
+	printf("%ld keys (%zu distinct), height %d\n", count, strings.count, height(root));
+	printf("insert           : %.2f M keys/s\n", count / insert_time / 1e6);
+	printf("lookup (prefix)  : %.2f M keys/s, %ld found\n", count / lookup_time / 1e6, found);
+	printf("lookup (strcmp)  : %.2f M keys/s, %ld found\n", count / strcmp_time / 1e6, found_strcmp);
+	printf("compares settled by the prefix: %.1f%%\n", 100.0 * by_prefix / compares);
+
+	free_tree(root);
+	intern_clear();
+	free(text);
+	free(offsets);
+	return 0;
+}
+
+// Shared state of the concurrent read benchmark
+typedef struct read_bench {
+	persistent_avl *pavl;        // NULL: use the mutex-guarded tree
+	node *root;
+	pthread_mutex_t lock;
+	const char *text;
+	size_t *offsets;
+	long count;
+	atomic_int stop;
+	atomic_long lookups;
+} read_bench;
+
+void *bench_reader(void *arg) {
+	read_bench *b = (read_bench *) arg;
+	int slot = b -> pavl ? pavl_register_reader(b -> pavl) : 0;
+	uint64_t seed = (uint64_t) (uintptr_t) &slot | 1;
+	long done = 0;
+
+	while(!atomic_load_explicit(&b -> stop, memory_order_relaxed)) {
+		for(int i = 0; i < 64; i++) {
+			const char *key = b -> text + b -> offsets[bench_rand(&seed) % b -> count];
+			if(b -> pavl) {
+				node *root = pavl_read_begin(b -> pavl, slot);
+				search_node(root, key);
+				pavl_read_end(b -> pavl, slot);
+			} else {
+				pthread_mutex_lock(&b -> lock);
+				search_node(b -> root, key);
+				pthread_mutex_unlock(&b -> lock);
+			}
+		}
+		done += 64;
+	}
+	atomic_fetch_add(&b -> lookups, done);
+	return NULL;
+}
+
+// One writer inserts every key while the readers look up random keys;
+// returns the total reader lookups per second
+double run_read_bench(read_bench *b, int readers, double *insert_rate) {
+	pthread_t threads[MAX_READERS];
+	atomic_init(&b -> stop, 0);
+	atomic_init(&b -> lookups, 0);
+
+	for(int i = 0; i < readers; i++)
+		pthread_create(&threads[i], NULL, bench_reader, b);
+
+	double t = now_sec();
+	for(long i = 0; i < b -> count; i++) {
+		const char *key = b -> text + b -> offsets[i];
+		if(b -> pavl) {
+			pavl_insert(b -> pavl, key);
+		} else {
+			pthread_mutex_lock(&b -> lock);
+			b -> root = insert_node(b -> root, key);
+			pthread_mutex_unlock(&b -> lock);
+		}
+	}
+	double elapsed = now_sec() - t;
+	atomic_store(&b -> stop, 1);
+	for(int i = 0; i < readers; i++)
+		pthread_join(threads[i], NULL);
+
+	*insert_rate = b -> count / elapsed;
+	return atomic_load(&b -> lookups) / elapsed;
+}
+
+// 1 writer + N readers: persistent tree vs the mutable tree behind a mutex
+int bench_readers(long n, int max_readers) {
+	read_bench b = {0};
+	b.count = load_keys(n, NULL, (char **) &b.text, &b.offsets);
+	pthread_mutex_init(&b.lock, NULL);
+
+	printf("%ld inserts by 1 writer, reader lookups in M/s\n", b.count);
+	for(int readers = 1; readers <= max_readers; readers *= 2) {
+		double w_mutex, w_pavl;
+
+		b.pavl = NULL;
+		b.root = NULL;
+		double mutex_rate = run_read_bench(&b, readers, &w_mutex);
+		free_tree(b.root);
+		intern_clear();
+
+		persistent_avl pavl;
+		pavl_init(&pavl);
+		b.pavl = &pavl;
+		double pavl_rate = run_read_bench(&b, readers, &w_pavl);
+		pavl_destroy(&pavl);
+		intern_clear();
+
+		printf("%2d readers: mutex %.2f (writer %.2f M/s), persistent %.2f (writer %.2f M/s), "
+		       "%zu nodes left\n", readers, mutex_rate / 1e6, w_mutex / 1e6,
+		       pavl_rate / 1e6, w_pavl / 1e6, node_pool.live);
+	}
+
+	pthread_mutex_destroy(&b.lock);
+	free((char *) b.text);
+	free(b.offsets);
+	return 0;
+}
+
+// Build with -pthread. "bench [n] [key file]" inserts and looks up n
+// string keys; "bench readers [n] [max readers]" runs 1 writer against
+// N readers on the persistent and the mutex-guarded tree.
+int main(int argc, char **argv) {
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "readers"))
+		return bench_readers(argc > 3 ? atol(argv[3]) : 1000000, argc > 4 ? atoi(argv[4]) : 8);
+	if(argc > 1 && !strcmp(argv[1], "bench"))
+		return bench(argc > 2 ? atol(argv[2]) : 10000000, argc > 3 ? argv[3] : NULL);
+
 	node *root = NULL;
 	const char *months[] = {
 		"December", "January", "April", "March", "July",
@@ -153,5 +674,7 @@ int main() {
 	printf("\n");
 
 	free_tree(root);
+	pool_destroy(&node_pool);
+	intern_clear();
 	return 0;
 }
@@ -1,6 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pool.h"
+#include "bench.h"
 
 #define RED 1
 #define BLACK 0
@@ -15,11 +24,22 @@ typedef struct node {
 
 typedef struct rb_tree {
 	node *root;
+	node *rightmost;    // largest timestamp, where in-order appends go
+	time_t retention;   // keep only this many seconds (0: keep everything)
+	time_t next_evict;  // newest timestamp that triggers the next eviction
+	pool nodes;    // every node of this tree is allocated here
 } rb_tree;
 
+// Initialize an empty tree with its own node pool
+void init_tree(rb_tree *rbt) {
+	rbt -> root = rbt -> rightmost = NULL;
+	rbt -> retention = rbt -> next_evict = 0;
+	pool_init(&rbt -> nodes, sizeof(node));
+}
+
 // Create a new red node with a given timestamp
-node *create_node(time_t timestamp) {
-	node *n = (node *) malloc(sizeof(node));
+node *create_node(rb_tree *rbt, time_t timestamp) {
+	node *n = (node *) pool_alloc(&rbt -> nodes);
 
 	// Initialize node fields
 	n -> timestamp = timestamp;
@@ -153,12 +173,11 @@ void fixup(rb_tree *rbt, node *z) {
 	rbt -> root -> color = BLACK;
 }
 
-// Insert a new node with given timestamp into the Red-Black Tree
-node *insert_node(rb_tree *rbt, time_t timestamp) {
-	node *z = create_node(timestamp);
-	node *p = rbt -> root;
-	node *q = NULL;
+void enforce_retention(rb_tree *rbt);
 
+// Descend from p (a child of q) to the empty slot for timestamp and
+// attach a new node there; returns NULL if timestamp is already present
+node *insert_below(rb_tree *rbt, node *q, node *p, time_t timestamp) {
 	// Standard BST insert
 	while(p != NULL) {
 		q = p;
@@ -166,13 +185,12 @@ node *insert_node(rb_tree *rbt, time_t timestamp) {
 			p = p -> left;
 		else if(timestamp > p -> timestamp)
 			p = p -> right;
-		else {
-			free(z);
-			return rbt -> root;
-		}
+		else
+			return NULL;
 	}
 
 	// Attach new node to the found parent
+	node *z = create_node(rbt, timestamp);
 	z -> parent = q;
 	if(q == NULL)
 		rbt -> root = z;
@@ -181,23 +199,413 @@ node *insert_node(rb_tree *rbt, time_t timestamp) {
 	else
 		q -> right = z;
 
+	if(!rbt -> rightmost || timestamp > rbt -> rightmost -> timestamp)
+		rbt -> rightmost = z;
+
 	// Fix color and balance violations
 	fixup(rbt, z);
+	return z;
+}
+
+// Insert a new node with given timestamp into the Red-Black Tree.
+// Timestamps arrive almost in order, so the search starts at the cached
+// rightmost node and climbs its ancestors (the right spine) only while
+// they are newer than timestamp: in-order appends attach directly and
+// slightly late ones descend a small subtree instead of the whole tree.
+node *insert_node(rb_tree *rbt, time_t timestamp) {
+	node *r = rbt -> rightmost;
+
+	while(r && r -> timestamp > timestamp)
+		r = r -> parent;
+
+	if(!r)
+		insert_below(rbt, NULL, rbt -> root, timestamp);
+	else if(r -> timestamp != timestamp)
+		// everything in r's right subtree is newer than r
+		insert_below(rbt, r, r -> right, timestamp);
+
+	if(rbt -> retention)
+		enforce_retention(rbt);
 
 	return rbt -> root;
 }
 
+// Insert descending from the root every time (for comparison)
+node *insert_node_from_root(rb_tree *rbt, time_t timestamp) {
+	insert_below(rbt, NULL, rbt -> root, timestamp);
+	return rbt -> root;
+}
+
 // Search for a node with a specific timestamp (BST search)
 node *search_node(node *root, time_t timestamp) {
-	if(!root)
+	while(root && root -> timestamp != timestamp) {
+		if(timestamp < root -> timestamp)
+			root = root -> left;
+		else
+			root = root -> right;
+	}
+	return root;
+}
+
+// Inorder successor, using parent pointers
+node *successor(node *n) {
+	if(n -> right) {
+		n = n -> right;
+		while(n -> left)
+			n = n -> left;
+		return n;
+	}
+	while(n -> parent && n == n -> parent -> right)
+		n = n -> parent;
+	return n -> parent;
+}
+
+// First node with timestamp >= t, or NULL
+node *lower_bound(node *root, time_t t) {
+	node *best = NULL;
+	while(root) {
+		if(root -> timestamp >= t) {
+			best = root;
+			root = root -> left;
+		} else {
+			root = root -> right;
+		}
+	}
+	return best;
+}
+
+// Iterator over the timestamps in [t0, t1), in ascending order. It walks
+// successors through parent pointers, so it needs no stack and the tree
+// must not be modified while it is in use.
+typedef struct range_iter {
+	node *next;
+	time_t end;
+} range_iter;
+
+void range_init(range_iter *it, rb_tree *rbt, time_t t0, time_t t1) {
+	it -> next = lower_bound(rbt -> root, t0);
+	it -> end = t1;
+}
+
+node *range_next(range_iter *it) {
+	node *n = it -> next;
+	if(!n || n -> timestamp >= it -> end)
 		return NULL;
+	it -> next = successor(n);
+	return n;
+}
 
-	if(timestamp < root -> timestamp)
-		return search_node(root -> left, timestamp);
-	else if(timestamp > root -> timestamp)
-		return search_node(root -> right, timestamp);
+// Inorder predecessor, using parent pointers
+node *predecessor(node *n) {
+	if(n -> left) {
+		n = n -> left;
+		while(n -> right)
+			n = n -> right;
+		return n;
+	}
+	while(n -> parent && n == n -> parent -> left)
+		n = n -> parent;
+	return n -> parent;
+}
+
+// Rotations that keep rbt -> root up to date
+void rotate_left(rb_tree *rbt, node *x) {
+	node *y = left_rotate(x);
+	if(rbt -> root == x)
+		rbt -> root = y;
+}
+
+void rotate_right(rb_tree *rbt, node *x) {
+	node *y = right_rotate(x);
+	if(rbt -> root == x)
+		rbt -> root = y;
+}
+
+int is_black(node *n) {
+	return !n || n -> color == BLACK;
+}
+
+// Put v (possibly NULL) in u's place under u's parent
+void transplant(rb_tree *rbt, node *u, node *v) {
+	if(!u -> parent)
+		rbt -> root = v;
+	else if(u == u -> parent -> left)
+		u -> parent -> left = v;
 	else
-		return root;
+		u -> parent -> right = v;
+	if(v)
+		v -> parent = u -> parent;
+}
+
+// Fix Red-Black Tree properties after removing a black node. x carries the
+// extra black and may be NULL, so its parent is passed separately.
+void delete_fixup(rb_tree *rbt, node *x, node *xp) {
+	while(x != rbt -> root && is_black(x)) {
+		// Case 1: x is a left child
+		if(x == xp -> left) {
+			node *w = xp -> right;
+
+			// Red sibling: rotate so the sibling becomes black
+			if(w -> color == RED) {
+				w -> color = BLACK;
+				xp -> color = RED;
+				rotate_left(rbt, xp);
+				w = xp -> right;
+			}
+
+			// Both nephews black: push the extra black up
+			if(is_black(w -> left) && is_black(w -> right)) {
+				w -> color = RED;
+				x = xp;
+				xp = x -> parent;
+			}
+
+			// A red nephew absorbs the extra black with one or two rotations
+			else {
+				if(is_black(w -> right)) {
+					w -> left -> color = BLACK;
+					w -> color = RED;
+					rotate_right(rbt, w);
+					w = xp -> right;
+				}
+				w -> color = xp -> color;
+				xp -> color = BLACK;
+				w -> right -> color = BLACK;
+				rotate_left(rbt, xp);
+				x = rbt -> root;
+			}
+		}
+		// Case 2: x is a right child (mirror image)
+		else {
+			node *w = xp -> left;
+
+			if(w -> color == RED) {
+				w -> color = BLACK;
+				xp -> color = RED;
+				rotate_right(rbt, xp);
+				w = xp -> left;
+			}
+
+			if(is_black(w -> left) && is_black(w -> right)) {
+				w -> color = RED;
+				x = xp;
+				xp = x -> parent;
+			}
+
+			else {
+				if(is_black(w -> left)) {
+					w -> right -> color = BLACK;
+					w -> color = RED;
+					rotate_left(rbt, w);
+					w = xp -> left;
+				}
+				w -> color = xp -> color;
+				xp -> color = BLACK;
+				w -> left -> color = BLACK;
+				rotate_right(rbt, xp);
+				x = rbt -> root;
+			}
+		}
+	}
+
+	if(x)
+		x -> color = BLACK;
+}
+
+// Delete the node with the given timestamp; returns 0 if it is not present
+int delete_node(rb_tree *rbt, time_t timestamp) {
+	node *z = search_node(rbt -> root, timestamp);
+	if(!z)
+		return 0;
+
+	if(z == rbt -> rightmost)
+		rbt -> rightmost = predecessor(z);
+
+	node *x, *xp;
+	int removed_color = z -> color;
+
+	// At most one child: splice z out
+	if(!z -> left) {
+		x = z -> right;
+		xp = z -> parent;
+		transplant(rbt, z, z -> right);
+	}
+	else if(!z -> right) {
+		x = z -> left;
+		xp = z -> parent;
+		transplant(rbt, z, z -> left);
+	}
+
+	// Two children: the successor y takes z's place and colour
+	else {
+		node *y = z -> right;
+		while(y -> left)
+			y = y -> left;
+		removed_color = y -> color;
+		x = y -> right;
+
+		if(y -> parent == z) {
+			xp = y;
+		}
+		else {
+			xp = y -> parent;
+			transplant(rbt, y, y -> right);
+			y -> right = z -> right;
+			y -> right -> parent = y;
+		}
+		transplant(rbt, z, y);
+		y -> left = z -> left;
+		y -> left -> parent = y;
+		y -> color = z -> color;
+	}
+
+	if(removed_color == BLACK)
+		delete_fixup(rbt, x, xp);
+
+	pool_free(&rbt -> nodes, z);
+	return 1;
+}
+
+// Number of black nodes on any path from n down to a leaf
+int black_height(node *n) {
+	int h = 0;
+	for(; n; n = n -> left)
+		h += n -> color == BLACK;
+	return h;
+}
+
+// Join two red-black trees with l < k < r (roots black, parents NULL)
+// into one, in O(log n): k is hung at the spot on the taller tree's spine
+// with the shorter tree's black height, then the usual insert fixup runs
+node *join(node *l, node *k, node *r) {
+	int hl = black_height(l), hr = black_height(r);
+	rb_tree t;
+
+	k -> parent = NULL;
+	if(hl == hr) {
+		k -> left = l;
+		k -> right = r;
+		if(l)
+			l -> parent = k;
+		if(r)
+			r -> parent = k;
+		k -> color = BLACK;
+		return k;
+	}
+
+	// Walk down the taller tree's inner spine to a black node (or NULL)
+	// whose black height matches the other tree
+	node *c, *cp = NULL;
+	int h;
+	if(hl > hr) {
+		for(c = l, h = hl; c && (c -> color == RED || h > hr); c = c -> right) {
+			h -= c -> color == BLACK;
+			cp = c;
+		}
+		k -> left = c;
+		k -> right = r;
+		cp -> right = k;
+		t.root = l;
+	}
+	else {
+		for(c = r, h = hr; c && (c -> color == RED || h > hl); c = c -> left) {
+			h -= c -> color == BLACK;
+			cp = c;
+		}
+		k -> left = l;
+		k -> right = c;
+		cp -> left = k;
+		t.root = r;
+	}
+	if(k -> left)
+		k -> left -> parent = k;
+	if(k -> right)
+		k -> right -> parent = k;
+	k -> parent = cp;
+	k -> color = RED;
+
+	fixup(&t, k);
+	return t.root;
+}
+
+// Detach a subtree as a standalone red-black tree (root black, no parent)
+node *detach(node *n) {
+	if(n) {
+		n -> parent = NULL;
+		n -> color = BLACK;
+	}
+	return n;
+}
+
+// Split the tree rooted at t into *l (timestamps < key) and *r (>= key)
+// by re-joining the subtrees hanging off the search path: O(log^2 n)
+void split(node *t, time_t key, node **l, node **r) {
+	if(!t) {
+		*l = *r = NULL;
+		return;
+	}
+
+	node *tl = detach(t -> left), *tr = detach(t -> right);
+	node *mid;
+	if(key <= t -> timestamp) {
+		split(tl, key, l, &mid);
+		*r = join(mid, t, tr);
+	}
+	else {
+		split(tr, key, &mid, r);
+		*l = join(tl, t, mid);
+	}
+}
+
+// Return every node of a detached subtree to the pool, walking parent
+// pointers so no stack is needed
+void free_subtree(rb_tree *rbt, node *n) {
+	while(n) {
+		if(n -> left)
+			n = n -> left;
+		else if(n -> right)
+			n = n -> right;
+		else {
+			node *p = n -> parent;
+			if(p) {
+				if(p -> left == n)
+					p -> left = NULL;
+				else
+					p -> right = NULL;
+			}
+			pool_free(&rbt -> nodes, n);
+			n = p;
+		}
+	}
+}
+
+// Drop every timestamp older than watermark with one split instead of
+// one delete per node; returns the number of nodes evicted
+size_t evict_before(rb_tree *rbt, time_t watermark) {
+	node *old, *keep;
+	size_t before = rbt -> nodes.live;
+
+	split(rbt -> root, watermark, &old, &keep);
+	rbt -> root = keep;
+	if(!keep)
+		rbt -> rightmost = NULL;
+	free_subtree(rbt, old);
+	return before - rbt -> nodes.live;
+}
+
+// Keep only the last `seconds` of data: inserts evict in batches, each
+// time the newest timestamp has moved another 1/16 of the window
+void retain_last(rb_tree *rbt, time_t seconds) {
+	rbt -> retention = seconds;
+	rbt -> next_evict = 0;
+}
+
+void enforce_retention(rb_tree *rbt) {
+	time_t newest = rbt -> rightmost -> timestamp;
+	if(newest < rbt -> next_evict)
+		return;
+	evict_before(rbt, newest - rbt -> retention);
+	rbt -> next_evict = newest + rbt -> retention / 16;
 }
 
 // Inorder traversal, prints nodes in ascending order
@@ -230,19 +638,693 @@ void postorder(node *root) {
 	printf("%s", ctime(&root -> timestamp));
 }
 
-// Free all nodes in the tree recursively
-void free_tree(node *root) {
-	if(!root)
-		return;
+// Free all nodes of the tree at once by releasing its pool
+void free_tree(rb_tree *rbt) {
+	pool_destroy(&rbt -> nodes);
+	rbt -> root = rbt -> rightmost = NULL;
+}
+
+// Snapshot file: a header, then the timestamps in ascending order in
+// blocks of up to SNAPSHOT_BLOCK values. Each block stores its count,
+// the byte length of its payload and its first timestamp; the payload is
+// the remaining deltas as LEB128 varints (near-sorted data: ~1 byte each).
+
+#define SNAPSHOT_MAGIC 0x53544252u   // "RBTS"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BLOCK 4096
+
+typedef struct snapshot_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t count;
+} snapshot_header;
+
+typedef struct block_header {
+	uint32_t count;
+	uint32_t bytes;
+	int64_t first;
+} block_header;
+
+size_t put_varint(uint8_t *out, uint64_t v) {
+	size_t n = 0;
+	while(v >= 0x80) {
+		out[n++] = (uint8_t) (v | 0x80);
+		v >>= 7;
+	}
+	out[n++] = (uint8_t) v;
+	return n;
+}
+
+// Write the tree's timestamps to path; returns 0 on success, -1 on error
+int save_snapshot(rb_tree *rbt, const char *path) {
+	FILE *f = fopen(path, "wb");
+	if(!f)
+		return -1;
+
+	snapshot_header h = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, rbt -> nodes.live};
+	fwrite(&h, sizeof(h), 1, f);
+
+	uint8_t payload[SNAPSHOT_BLOCK * 10];
+	node *n = rbt -> root;
+	while(n && n -> left)
+		n = n -> left;
 
-	free_tree(root -> left);
-	free_tree(root -> right);
-	free(root);
+	while(n) {
+		block_header b = {1, 0, (int64_t) n -> timestamp};
+		time_t prev = n -> timestamp;
+		for(n = successor(n); n && b.count < SNAPSHOT_BLOCK; n = successor(n)) {
+			b.bytes += put_varint(payload + b.bytes, (uint64_t) (n -> timestamp - prev));
+			prev = n -> timestamp;
+			b.count++;
+		}
+		fwrite(&b, sizeof(b), 1, f);
+		fwrite(payload, 1, b.bytes, f);
+	}
+	int err = ferror(f);
+	return fclose(f) || err ? -1 : 0;
+}
+
+// Sequential reader over the mapped blocks. Anything that would not have
+// come out of save_snapshot (overlong varints, a payload that does not
+// fill its declared length exactly, timestamps that do not strictly
+// ascend) sets bad, so a corrupt file never builds an unordered tree.
+typedef struct snapshot_reader {
+	const uint8_t *p, *end;
+	uint32_t left;      // values left in the current block
+	time_t prev;
+	int bad;            // truncated or corrupt file
+	const uint8_t *block_end;   // end of the current block's payload
+	int started;        // prev holds a timestamp
+} snapshot_reader;
+
+time_t snapshot_next(snapshot_reader *r) {
+	if(r -> bad)
+		return 0;
+	if(!r -> left) {
+		block_header b;
+		if(r -> end - r -> p < (long) sizeof(b)) {
+			r -> bad = 1;
+			return 0;
+		}
+		memcpy(&b, r -> p, sizeof(b));
+		r -> p += sizeof(b);
+		if(!b.count || b.bytes > r -> end - r -> p ||
+		   (r -> started && (time_t) b.first <= r -> prev)) {
+			r -> bad = 1;
+			return 0;
+		}
+		r -> block_end = r -> p + b.bytes;
+		r -> left = b.count - 1;
+		r -> started = 1;
+		if(!r -> left && r -> p != r -> block_end)
+			r -> bad = 1;
+		return r -> prev = (time_t) b.first;
+	}
+
+	// at most 10 bytes, the last holding bit 63 only
+	uint64_t delta = 0;
+	int shift = 0;
+	while(r -> p < r -> block_end && (*r -> p & 0x80) && shift < 63) {
+		delta |= (uint64_t) (*r -> p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	if(r -> p == r -> block_end || (*r -> p & 0x80) || (shift == 63 && *r -> p > 1)) {
+		r -> bad = 1;
+		return 0;
+	}
+	delta |= (uint64_t) *r -> p++ << shift;
+	// strictly ascending, without overflowing (the subtraction wraps to
+	// the right distance for negative prev too)
+	if(!delta || delta > (uint64_t) INT64_MAX - (uint64_t) r -> prev) {
+		r -> bad = 1;
+		return 0;
+	}
+	if(!--r -> left && r -> p != r -> block_end)
+		r -> bad = 1;
+	return r -> prev += (time_t) delta;
+}
+
+// Build a perfectly balanced subtree of count nodes from the next count
+// timestamps, in order. All levels above the deepest are full, so
+// colouring exactly the nodes at depth red_depth red (the incomplete last
+// level) gives every path the same black height.
+node *build_balanced(rb_tree *rbt, snapshot_reader *r, uint64_t count, int depth,
+                     int red_depth, node *parent) {
+	if(!count)
+		return NULL;
+
+	uint64_t left = (count - 1) / 2;
+	node *l = build_balanced(rbt, r, left, depth + 1, red_depth, NULL);
+	node *n = create_node(rbt, snapshot_next(r));
+	n -> parent = parent;
+	n -> color = depth == red_depth ? RED : BLACK;
+	n -> left = l;
+	if(l)
+		l -> parent = n;
+	rbt -> rightmost = n;   // creation order is ascending
+	n -> right = build_balanced(rbt, r, count - 1 - left, depth + 1, red_depth, n);
+	return n;
+}
+
+// Replace the contents of rbt with the snapshot at path: the file is
+// mapped and the tree is built in O(n) with no comparisons or rotations.
+// Returns 0 on success, -1 on error (rbt is left empty).
+int load_snapshot(rb_tree *rbt, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(snapshot_header)) {
+		close(fd);
+		return -1;
+	}
+	const uint8_t *data = (const uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED)
+		return -1;
+	madvise((void *) data, st.st_size, MADV_SEQUENTIAL);
+
+	snapshot_header h;
+	memcpy(&h, data, sizeof(h));
+	snapshot_reader r = {.p = data + sizeof(h), .end = data + st.st_size};
+
+	free_tree(rbt);
+	// every timestamp takes at least one byte, which bounds a corrupt count
+	if(h.magic == SNAPSHOT_MAGIC && h.version == SNAPSHOT_VERSION && h.count <= (uint64_t) st.st_size) {
+		// number of full levels: floor(log2(count + 1))
+		int full = 0;
+		while((2ULL << full) - 1 <= h.count)
+			full++;
+		rbt -> root = build_balanced(rbt, &r, h.count, 0, full, NULL);
+		if(r.left || r.p != r.end)
+			r.bad = 1;  // count disagrees with the blocks, or trailing bytes
+	} else {
+		r.bad = 1;
+	}
+	munmap((void *) data, st.st_size);
+
+	if(r.bad) {
+		free_tree(rbt);
+		return -1;
+	}
+	return 0;
+}
+
+// Time-partitioned index: time is cut into buckets of width seconds and
+// bucket b lives in slot b % nslots. Producers all write around the
+// current time, so each slot is further split into ways sub-shards picked
+// by a hash of the timestamp; concurrent writers to the same bucket then
+// mostly take different locks. Every sub-shard is a separate tree with
+// its own lock and node pool, and rotations in one cannot reach another.
+
+#define SHARD_BATCH 256   // timestamps a producer buffers per lock round
+#define MAX_WAYS 16       // sub-shards per bucket
+
+typedef struct shard {
+	pthread_mutex_t lock;
+	long rounds, contended;   // lock acquisitions, and how many had to wait
+	rb_tree tree;
+} __attribute__((aligned(64))) shard;
+
+typedef struct sharded_index {
+	shard *shards;        // nslots * ways, the ways of one slot adjacent
+	int count, ways;
+	time_t width;
+} sharded_index;
+
+void sharded_init(sharded_index *idx, int nslots, int ways, time_t width) {
+	if(ways > MAX_WAYS)
+		ways = MAX_WAYS;
+	idx -> count = nslots * ways;
+	idx -> ways = ways;
+	idx -> width = width;
+	idx -> shards = (shard *) aligned_alloc(64, idx -> count * sizeof(shard));
+	for(int i = 0; i < idx -> count; i++) {
+		pthread_mutex_init(&idx -> shards[i].lock, NULL);
+		idx -> shards[i].rounds = idx -> shards[i].contended = 0;
+		init_tree(&idx -> shards[i].tree);
+	}
+}
+
+void shard_lock(shard *s) {
+	int busy = pthread_mutex_trylock(&s -> lock) != 0;
+	if(busy)
+		pthread_mutex_lock(&s -> lock);
+	s -> rounds++;
+	s -> contended += busy;
+}
+
+// Bucket number of t, rounding down for times before the epoch
+time_t bucket_of(sharded_index *idx, time_t t) {
+	time_t b = t / idx -> width;
+	return b - (t % idx -> width < 0);
+}
+
+// Sub-shard of t within its bucket (Fibonacci hashing)
+int way_of(sharded_index *idx, time_t t) {
+	return (int) ((((uint64_t) t * 0x9E3779B97F4A7C15ull) >> 32) % idx -> ways);
+}
+
+// First of the ways sub-shards of bucket b
+shard *slot_of_bucket(sharded_index *idx, time_t b) {
+	time_t nslots = idx -> count / idx -> ways;
+	time_t s = b % nslots;
+	return &idx -> shards[(s < 0 ? s + nslots : s) * idx -> ways];
+}
+
+void sharded_insert(sharded_index *idx, time_t t) {
+	shard *s = slot_of_bucket(idx, bucket_of(idx, t)) + way_of(idx, t);
+	shard_lock(s);
+	insert_node(&s -> tree, t);
+	pthread_mutex_unlock(&s -> lock);
+}
+
+// Insert a producer's batch: sorting it groups the timestamps by bucket,
+// and each run of one bucket (taken SHARD_BATCH at a time, so batches of
+// any size work) is split by way, so every sub-shard touched costs a
+// single lock round trip and gets its timestamps in ascending
+// order (the rightmost fast path). The batch is reordered in place;
+// insertion sort because batches are small and nearly sorted already.
+void sharded_insert_batch(sharded_index *idx, time_t *ts, size_t n) {
+	for(size_t i = 1; i < n; i++) {
+		time_t t = ts[i];
+		size_t j = i;
+		for(; j > 0 && ts[j - 1] > t; j--)
+			ts[j] = ts[j - 1];
+		ts[j] = t;
+	}
+
+	unsigned char way[SHARD_BATCH];
+	size_t i = 0;
+	while(i < n) {
+		time_t b = bucket_of(idx, ts[i]);
+		size_t end = i;
+		unsigned used = 0;
+		for(; end < n && end - i < SHARD_BATCH && bucket_of(idx, ts[end]) == b; end++) {
+			way[end - i] = (unsigned char) way_of(idx, ts[end]);
+			used |= 1u << way[end - i];
+		}
+
+		shard *slot = slot_of_bucket(idx, b);
+		for(int w = 0; w < idx -> ways; w++) {
+			if(!(used & (1u << w)))
+				continue;
+			shard_lock(&slot[w]);
+			for(size_t k = i; k < end; k++)
+				if(way[k - i] == w)
+					insert_node(&slot[w].tree, ts[k]);
+			pthread_mutex_unlock(&slot[w].lock);
+		}
+		i = end;
+	}
+}
+
+// Visit the timestamps in [t0, t1) in ascending order. Buckets are
+// disjoint and visited in time order; within a bucket the ways are merged
+// by always taking the smallest head. Only the locks of one bucket are
+// held at a time, taken in index order. Returns the number of timestamps
+// visited.
+size_t sharded_range(sharded_index *idx, time_t t0, time_t t1,
+                     void (*visit)(time_t, void *), void *ctx) {
+	size_t found = 0;
+	if(t0 >= t1)
+		return 0;
+
+	for(time_t b = bucket_of(idx, t0); b <= bucket_of(idx, t1 - 1); b++) {
+		time_t lo = b * idx -> width, hi = lo + idx -> width;
+		shard *slot = slot_of_bucket(idx, b);
+		range_iter it[MAX_WAYS];
+		node *head[MAX_WAYS];
+
+		for(int w = 0; w < idx -> ways; w++) {
+			pthread_mutex_lock(&slot[w].lock);
+			range_init(&it[w], &slot[w].tree, lo > t0 ? lo : t0, hi < t1 ? hi : t1);
+			head[w] = range_next(&it[w]);
+		}
+		for(;;) {
+			int min = -1;
+			for(int w = 0; w < idx -> ways; w++)
+				if(head[w] && (min < 0 || head[w] -> timestamp < head[min] -> timestamp))
+					min = w;
+			if(min < 0)
+				break;
+			if(visit)
+				visit(head[min] -> timestamp, ctx);
+			found++;
+			head[min] = range_next(&it[min]);
+		}
+		for(int w = idx -> ways - 1; w >= 0; w--)
+			pthread_mutex_unlock(&slot[w].lock);
+	}
+	return found;
+}
+
+// Fraction of lock acquisitions that found the lock taken
+double sharded_contention(sharded_index *idx) {
+	long rounds = 0, contended = 0;
+	for(int i = 0; i < idx -> count; i++) {
+		rounds += idx -> shards[i].rounds;
+		contended += idx -> shards[i].contended;
+	}
+	return rounds ? (double) contended / rounds : 0;
+}
+
+size_t sharded_size(sharded_index *idx) {
+	size_t total = 0;
+	for(int i = 0; i < idx -> count; i++)
+		total += idx -> shards[i].tree.nodes.live;
+	return total;
+}
+
+void sharded_destroy(sharded_index *idx) {
+	for(int i = 0; i < idx -> count; i++) {
+		free_tree(&idx -> shards[i].tree);
+		pthread_mutex_destroy(&idx -> shards[i].lock);
+	}
+	free(idx -> shards);
+	idx -> shards = NULL;
 }
 
-int main() {
+// Check ordering, parent links and both red-black rules below n;
+// returns the black height, or -1 if anything is broken
+int check_subtree(node *n, node *parent, const time_t *lo, const time_t *hi) {
+	if(!n)
+		return 1;
+	if(n -> parent != parent || (lo && n -> timestamp <= *lo) || (hi && n -> timestamp >= *hi))
+		return -1;
+	if(n -> color == RED && ((n -> left && n -> left -> color == RED) ||
+	                         (n -> right && n -> right -> color == RED)))
+		return -1;
+
+	int l = check_subtree(n -> left, n, lo, &n -> timestamp);
+	int r = check_subtree(n -> right, n, &n -> timestamp, hi);
+	if(l < 0 || l != r)
+		return -1;
+	return l + (n -> color == BLACK);
+}
+
+int check_tree(rb_tree *rbt) {
+	node *max = rbt -> root;
+	while(max && max -> right)
+		max = max -> right;
+	if(max != rbt -> rightmost || (rbt -> root && rbt -> root -> color != BLACK))
+		return -1;
+	return check_subtree(rbt -> root, NULL, NULL, NULL);
+}
+
+// Near-sorted stream: one second apart, 1% arriving up to 1000 s late
+time_t next_timestamp(long i, uint64_t *seed) {
+	time_t t = 1700000000 + i;
+	uint64_t r = bench_rand(seed);
+	if(r % 100 == 0)
+		t -= (r >> 32) % 1000;
+	return t;
+}
+
+// Ingest rate with and without the rightmost fast path, then range scans
+int bench_ingest(long n) {
+	const char *names[] = {"from root", "rightmost"};
+	rb_tree rbt;
+	init_tree(&rbt);
+
+	for(int fast = 0; fast < 2; fast++) {
+		uint64_t seed = 42;
+		double t = now_sec();
+		for(long i = 0; i < n; i++) {
+			time_t ts = next_timestamp(i, &seed);
+			if(fast)
+				insert_node(&rbt, ts);
+			else
+				insert_node_from_root(&rbt, ts);
+		}
+		double elapsed = now_sec() - t;
+		printf("%-9s: %ld inserts, %.2f M/s, %zu nodes%s\n", names[fast], n,
+		       n / elapsed / 1e6, rbt.nodes.live, check_tree(&rbt) < 0 ? "  INVALID TREE" : "");
+		if(!fast)
+			free_tree(&rbt);
+	}
+
+	// Random 1000-second windows
+	const long scans = 1000000;
+	uint64_t seed = 7;
+	long total = 0;
+	double t = now_sec();
+	for(long i = 0; i < scans; i++) {
+		range_iter it;
+		time_t t0 = 1700000000 + (time_t) (bench_rand(&seed) % n);
+		range_init(&it, &rbt, t0, t0 + 1000);
+		while(range_next(&it))
+			total++;
+	}
+	double elapsed = now_sec() - t;
+	printf("range scans: %.2f M scans/s, %.1f M timestamps/s\n",
+	       scans / elapsed / 1e6, total / elapsed / 1e6);
+
+	free_tree(&rbt);
+	return 0;
+}
+
+int compare_double(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+// Continuous ingest under a retention window: eviction latency (p50/p99)
+// and RSS for the bulk split versus one delete per expired node
+int bench_retention(long n, time_t window) {
+	const char *names[] = {"split", "deletes"};
+
+	for(int by_delete = 0; by_delete < 2; by_delete++) {
+		rb_tree rbt;
+		init_tree(&rbt);
+		retain_last(&rbt, window);
+
+		// one eviction per window / 16 seconds of stream; grown if late
+		// arrivals or a tiny window trigger more
+		long step = window / 16 > 0 ? window / 16 : 1;
+		long cap = n / step + 2, evictions = 0;
+		double *lat = (double *) malloc(cap * sizeof(double));
+		long rss_mid = 0;
+		uint64_t seed = 42;
+		double start = now_sec();
+
+		for(long i = 0; i < n; i++) {
+			time_t ts = next_timestamp(i, &seed);
+			int evicts = rbt.rightmost && ts >= rbt.next_evict;
+			if(!evicts) {
+				insert_node(&rbt, ts);
+				continue;
+			}
+
+			double t = now_sec();
+			if(by_delete) {
+				// same trigger points, one delete_node per expired timestamp
+				rbt.retention = 0;
+				insert_node(&rbt, ts);
+				rbt.retention = window;
+				node *oldest = rbt.root;
+				while(oldest -> left)
+					oldest = oldest -> left;
+				time_t watermark = rbt.rightmost -> timestamp - window;
+				while(oldest && oldest -> timestamp < watermark) {
+					delete_node(&rbt, oldest -> timestamp);
+					for(oldest = rbt.root; oldest && oldest -> left; oldest = oldest -> left)
+						;
+				}
+				rbt.next_evict = rbt.rightmost -> timestamp + window / 16;
+			} else {
+				insert_node(&rbt, ts);
+			}
+			if(evictions == cap) {
+				cap *= 2;
+				lat = (double *) realloc(lat, cap * sizeof(double));
+			}
+			lat[evictions++] = now_sec() - t;
+			if(i >= n / 2 && !rss_mid)
+				rss_mid = rss_kb();
+		}
+		double elapsed = now_sec() - start;
+
+		qsort(lat, evictions, sizeof(double), compare_double);
+		printf("%-7s: %.2f M inserts/s, %zu nodes kept, %ld evictions, p50 %.3f ms, p99 %.3f ms, "
+		       "RSS %ld kB at half way, %ld kB at end%s\n", names[by_delete], n / elapsed / 1e6,
+		       rbt.nodes.live, evictions, evictions ? lat[evictions / 2] * 1e3 : 0,
+		       evictions ? lat[evictions * 99 / 100] * 1e3 : 0, rss_mid, rss_kb(),
+		       check_tree(&rbt) < 0 ? "  INVALID TREE" : "");
+		free(lat);
+		free_tree(&rbt);
+	}
+	return 0;
+}
+
+// Snapshot size, save time and cold-start time against re-inserting
+int bench_snapshot(long n) {
+	char path[] = "/tmp/rbsnap.XXXXXX";
+	int fd = mkstemp(path);
+	if(fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	rb_tree rbt;
+	init_tree(&rbt);
+	uint64_t seed = 42;
+	for(long i = 0; i < n; i++)
+		insert_node(&rbt, next_timestamp(i, &seed));
+	size_t count = rbt.nodes.live;
+
+	double t = now_sec();
+	if(save_snapshot(&rbt, path) < 0) {
+		perror(path);
+		return 1;
+	}
+	double save_time = now_sec() - t;
+	free_tree(&rbt);
+
+	struct stat st;
+	stat(path, &st);
+	printf("%zu timestamps: snapshot %.1f MB (%.2f bytes each, raw %zu), saved in %.2f s\n",
+	       count, st.st_size / 1048576.0, (double) st.st_size / count, sizeof(time_t), save_time);
+
+	t = now_sec();
+	int ok = load_snapshot(&rbt, path) == 0;
+	double load_time = now_sec() - t;
+	ok = ok && rbt.nodes.live == count && check_tree(&rbt) >= 0;
+	printf("load (mmap + O(n) build): %.2f s%s\n", load_time,
+	       ok ? "" : "  INVALID TREE");
+
+	// Baseline: decode the same file and insert every timestamp
+	int fd2 = open(path, O_RDONLY);
+	uint8_t *data = (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd2, 0);
+	close(fd2);
+	snapshot_reader r = {.p = data + sizeof(snapshot_header), .end = data + st.st_size};
+	rb_tree again;
+	init_tree(&again);
+	t = now_sec();
+	for(size_t i = 0; i < count; i++)
+		insert_node_from_root(&again, snapshot_next(&r));
+	printf("re-insert from the root: %.2f s\n", now_sec() - t);
+	munmap(data, st.st_size);
+
+	free_tree(&again);
+	free_tree(&rbt);
+	unlink(path);
+	return 0;
+}
+
+// Multi-producer ingest: producer p replays events p, p + P, p + 2P, ...
+// of the near-sorted stream, so all producers write around the same time
+typedef struct producer {
+	sharded_index *idx;
+	long n;
+	int id, count;
+	int batched;
+} producer;
+
+void *produce(void *arg) {
+	producer *p = (producer *) arg;
+	time_t batch[SHARD_BATCH];
+	size_t len = 0;
+	uint64_t seed = 42 + p -> id;
+
+	for(long i = p -> id; i < p -> n; i += p -> count) {
+		time_t t = next_timestamp(i, &seed);
+		if(!p -> batched) {
+			sharded_insert(p -> idx, t);
+			continue;
+		}
+		batch[len++] = t;
+		if(len == SHARD_BATCH) {
+			sharded_insert_batch(p -> idx, batch, len);
+			len = 0;
+		}
+	}
+	sharded_insert_batch(p -> idx, batch, len);
+	return NULL;
+}
+
+// Range visitor: *ctx holds the previous timestamp, or -1 once the
+// sequence went backwards
+void check_ascending(time_t t, void *ctx) {
+	time_t *last = (time_t *) ctx;
+	*last = *last >= 0 && t >= *last ? t : -1;
+}
+
+// Ingest rate against producer count: one tree with and without batching
+// separates the cost of locking per timestamp from the gain of sharding,
+// and 64 buckets of one way (the time split alone) from 8 buckets of 8
+// ways (where producers writing the same second use different locks)
+int bench_sharded(long n, int max_threads) {
+	static const struct {
+		const char *name;
+		int slots, ways, batched;
+	} layouts[] = {
+		{"1 tree, 1 lock", 1, 1, 0},
+		{"1 tree, batched", 1, 1, 1},
+		{"64 x 1 shards, batched", 64, 1, 1},
+		{"8 x 8 shards, batched", 8, 8, 1},
+	};
+	for(int threads = 1; threads <= max_threads; threads *= 2) {
+		size_t reference = 0;
+		for(int l = 0; l < 4; l++) {
+			sharded_index idx;
+			sharded_init(&idx, layouts[l].slots, layouts[l].ways, 60);
+
+			pthread_t tid[threads];
+			producer p[threads];
+			double t = now_sec();
+			for(int i = 0; i < threads; i++) {
+				p[i] = (producer) {&idx, n, i, threads, layouts[l].batched};
+				pthread_create(&tid[i], NULL, produce, &p[i]);
+			}
+			for(int i = 0; i < threads; i++)
+				pthread_join(tid[i], NULL);
+			double elapsed = now_sec() - t;
+
+			int valid = 1;
+			for(int i = 0; i < idx.count; i++)
+				valid = valid && check_tree(&idx.shards[i].tree) >= 0;
+
+			// One day of data spread over every shard, checked for order
+			time_t last = 0;
+			t = now_sec();
+			size_t day = sharded_range(&idx, 1700000000 + n / 2, 1700000000 + n / 2 + 86400,
+			                           check_ascending, &last);
+			double scan = now_sec() - t;
+
+			printf("%2d producers, %-22s: %.2f M/s, %4.1f%% contended, %zu stored, "
+			       "day scan %zu in %.2f ms%s\n",
+			       threads, layouts[l].name, n / elapsed / 1e6, 100 * sharded_contention(&idx),
+			       sharded_size(&idx), day, scan * 1e3, valid && last >= 0 ? "" : "  INVALID");
+			if(!reference)
+				reference = day;
+			else if(day != reference)
+				printf("range mismatch: %zu vs %zu\n", day, reference);
+			sharded_destroy(&idx);
+		}
+	}
+	return 0;
+}
+
+// "bench ingest [n]" measures near-sorted ingest and range scans;
+// "bench retention [n] [window seconds]" measures eviction;
+// "bench snapshot [n]" measures snapshot size and reload time;
+// "bench sharded [n] [max producers]" measures multi-producer ingest
+int main(int argc, char **argv) {
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "sharded"))
+		return bench_sharded(argc > 3 ? atol(argv[3]) : 20000000,
+		                     argc > 4 ? atoi(argv[4]) : 8);
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "snapshot"))
+		return bench_snapshot(argc > 3 ? atol(argv[3]) : 100000000);
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "ingest"))
+		return bench_ingest(argc > 3 ? atol(argv[3]) : 100000000);
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "retention"))
+		return bench_retention(argc > 3 ? atol(argv[3]) : 20000000,
+		                       argc > 4 ? atol(argv[4]) : 1000000);
+
 	rb_tree rbt;
-	rbt.root = NULL;
+	init_tree(&rbt);
 
 	// Seed random number generator
 	srand(time(NULL));
@@ -269,7 +1351,7 @@ int main() {
 	printf("\n");
 
 	// Free allocated memory
-	free_tree(rbt.root);
+	free_tree(&rbt);
 
 	return 0;
 }
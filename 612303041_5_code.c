@@ -1,75 +1,185 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <errno.h>
 #include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pool.h"
+#include "bench.h"
 
-#define MAX_LEVEL 5
-// probability for random level generation
-#define P 0.5
+// Hard cap on levels; the list's own limit grows with log2 of its size
+#define MAX_LEVEL 32
+#define MIN_LEVEL 4
 
 typedef struct node {
     int key;
-    struct node *forward[MAX_LEVEL];
+    int level;                  // number of forward pointers
+    int value;                  // payload when used as a memtable
+    struct node *forward[];     // sized to the node's level, followed by
+                                // level spans (see SPAN)
 } node;
 
+// Span of the link forward[i]: how many level-0 steps it skips (for a
+// NULL link, the number of nodes after this one). Summing spans on the
+// way down gives a node's rank.
+#define SPAN(n) ((unsigned *) ((n) -> forward + (n) -> level))
+
 typedef struct skip_list {
-    int level;
+    int level;                  // highest level in use
+    int max_level;              // levels allowed at the current size
+    size_t count;
     node *header;
+    pool nodes[MAX_LEVEL];      // pool k holds the nodes with k + 1 levels
 } skip_list;
 
-// create node
-node *create_node(int key, int level) {
-    node *n = (node *) malloc(sizeof(node));
+// create node with level forward pointers
+node *create_node(skip_list *list, int key, int level) {
+    node *n = (node *) pool_alloc(&list -> nodes[level - 1]);
     n -> key = key;
-    for (int i = 0; i < MAX_LEVEL; i++)
+    n -> level = level;
+    n -> value = 0;
+    for (int i = 0; i < level; i++) {
         n -> forward[i] = NULL;
+        SPAN(n)[i] = 0;
+    }
     return n;
 }
 
-// random level generator
-int random_level() {
-    int lvl = 0;
-    while ((rand() < P * RAND_MAX) && lvl < MAX_LEVEL - 1)
-        lvl++;
-    return lvl;
+// per-thread generator state for random_level
+static __thread uint64_t level_seed;
+
+// random level generator: index i with probability 2^-(i + 1), taken from
+// the trailing zeros of one random word, capped below max_level
+int random_level(int max_level) {
+    if (!level_seed)
+        level_seed = (uint64_t) time(0) ^ (uintptr_t) &level_seed ^ 0x9E3779B97F4A7C15ULL;
+    int lvl = __builtin_ctzll(bench_rand(&level_seed) | 1ULL << 63);
+    return lvl < max_level - 1 ? lvl : max_level - 1;
 }
 
 // create empty skip list
 skip_list *create_skip_list() {
     skip_list *list = (skip_list *) malloc(sizeof(skip_list));
     list -> level = 0;
-    // assign header with dummy key
-    list -> header = create_node(-1, MAX_LEVEL);
+    list -> max_level = MIN_LEVEL;
+    list -> count = 0;
+    for (int i = 0; i < MAX_LEVEL; i++)
+        pool_init(&list -> nodes[i], sizeof(node) + (i + 1) * (sizeof(node *) + sizeof(unsigned)));
+    // assign header with dummy key, tall enough for any node
+    list -> header = create_node(list, -1, MAX_LEVEL);
     return list;
 }
 
-// insert key
-void insert(skip_list *list, int key) {
-    node *update[MAX_LEVEL];
-    node *p = list -> header;
+// Link a new node for key after update[i] on each of its levels; rank[i]
+// is the rank of update[i] (header: 0). Leaves update/rank pointing at the
+// new node on its levels, ready for the next larger key.
+node *link_node(skip_list *list, int key, node **update, size_t *rank) {
+    // allow one more level each time the list doubles past 2^max_level
+    if (++list -> count >> list -> max_level && list -> max_level < MAX_LEVEL)
+        list -> max_level++;
 
-    // move down levels to find position
-    for (int i = list -> level; i >= 0; i--) {
-        while (p -> forward[i] && p -> forward[i] -> key < key)
+    int lvl = random_level(list -> max_level);
+    if (lvl > list -> level) {
+        for (int i = list -> level + 1; i <= lvl; i++) {
+            update[i] = list -> header;
+            rank[i] = 0;
+            SPAN(list -> header)[i] = list -> count - 1;
+        }
+        list -> level = lvl;
+    }
+
+    node *new_node = create_node(list, key, lvl + 1);
+    size_t r = rank[0] + 1;
+    for (int i = 0; i <= lvl; i++) {
+        new_node -> forward[i] = update[i] -> forward[i];
+        update[i] -> forward[i] = new_node;
+        SPAN(new_node)[i] = SPAN(update[i])[i] - (r - 1 - rank[i]);
+        SPAN(update[i])[i] = r - rank[i];
+        update[i] = new_node;
+        rank[i] = r;
+    }
+    // links above the new node now skip one more node
+    for (int i = lvl + 1; i <= list -> level; i++)
+        SPAN(update[i])[i]++;
+    return new_node;
+}
+
+// Walk down from level top starting at p (rank r), recording in update and
+// rank the last node before key on each level. A level keeps its finger
+// from an earlier descent if that is already further right.
+void descend(node *p, size_t r, int top, int key, node **update, size_t *rank) {
+    for (int i = top; i >= 0; i--) {
+        while (p -> forward[i] && p -> forward[i] -> key < key) {
+            r += SPAN(p)[i];
             p = p -> forward[i];
+        }
         update[i] = p;
+        rank[i] = r;
+        if (i && rank[i - 1] > r && update[i - 1] -> key < key) {
+            p = update[i - 1];
+            r = rank[i - 1];
+        }
     }
+}
 
-    p = p -> forward[0];
+// insert key; returns its node, new or already present
+node *insert(skip_list *list, int key) {
+    node *update[MAX_LEVEL];
+    size_t rank[MAX_LEVEL] = {0};
 
-    if (!p || p -> key != key) {
-        int lvl = random_level();
-        if (lvl > list -> level) {
-            for (int i = list -> level + 1; i <= lvl; i++)
+    // move down levels to find position
+    descend(list -> header, 0, list -> level, key, update, rank);
+
+    node *p = update[0] -> forward[0];
+    if (!p || p -> key != key)
+        p = link_node(list, key, update, rank);
+    return p;
+}
+
+// Insert keys sorted in ascending order. Each key starts from the previous
+// key's update[] path: it climbs only as high as the next links still fall
+// short of the key, so a run of close keys costs O(log gap) instead of a
+// full descent each. Returns the number of keys added.
+size_t insert_sorted(skip_list *list, const int *keys, size_t n) {
+    node *update[MAX_LEVEL];
+    size_t rank[MAX_LEVEL] = {0};
+    size_t added = 0;
+
+    for (int i = 0; i < MAX_LEVEL; i++)
+        update[i] = list -> header;
+    for (size_t k = 0; k < n; k++) {
+        int key = keys[k];
+        int top = list -> level;
+        if (k && key > keys[k - 1]) {
+            top = 0;
+            while (top < list -> level && update[top] -> forward[top] &&
+                   update[top] -> forward[top] -> key < key)
+                top++;
+        } else {
+            // first key or out of order: full descent from the header
+            for (int i = 0; i <= list -> level; i++) {
                 update[i] = list -> header;
-            list -> level = lvl;
+                rank[i] = 0;
+            }
         }
+        descend(update[top], rank[top], top, key, update, rank);
 
-        node *new_node = create_node(key, lvl + 1);
-        for (int i = 0; i <= lvl; i++) {
-            new_node -> forward[i] = update[i] -> forward[i];
-            update[i] -> forward[i] = new_node;
+        node *p = update[0] -> forward[0];
+        if (!p || p -> key != key) {
+            link_node(list, key, update, rank);
+            added++;
         }
     }
+    return added;
 }
 
 // search key
@@ -85,6 +195,61 @@ node *search(skip_list *list, int key) {
     return NULL;
 }
 
+// 1-based position of key in sorted order, 0 if absent
+size_t rank_of(skip_list *list, int key) {
+    node *p = list -> header;
+    size_t r = 0;
+    for (int i = list -> level; i >= 0; i--) {
+        while (p -> forward[i] && p -> forward[i] -> key <= key) {
+            r += SPAN(p)[i];
+            p = p -> forward[i];
+        }
+        if (p != list -> header && p -> key == key)
+            return r;
+    }
+    return 0;
+}
+
+// k-th smallest key (1-based), NULL if k is out of range
+node *select_kth(skip_list *list, size_t k) {
+    node *p = list -> header;
+    size_t r = 0;
+    for (int i = list -> level; i >= 0; i--) {
+        while (p -> forward[i] && r + SPAN(p)[i] <= k) {
+            r += SPAN(p)[i];
+            p = p -> forward[i];
+        }
+        if (r == k)
+            return p == list -> header ? NULL : p;
+    }
+    return NULL;
+}
+
+// Iterator over the keys in [lo, hi): one descent to the first key, then
+// level-0 links only. The list must not change while it is in use.
+typedef struct range_iter {
+    node *next;
+    int end;
+} range_iter;
+
+void range_init(range_iter *it, skip_list *list, int lo, int hi) {
+    node *p = list -> header;
+    for (int i = list -> level; i >= 0; i--) {
+        while (p -> forward[i] && p -> forward[i] -> key < lo)
+            p = p -> forward[i];
+    }
+    it -> next = p -> forward[0];
+    it -> end = hi;
+}
+
+node *range_next(range_iter *it) {
+    node *n = it -> next;
+    if (!n || n -> key >= it -> end)
+        return NULL;
+    it -> next = n -> forward[0];
+    return n;
+}
+
 // delete key
 void delete(skip_list *list, int key) {
     node *update[MAX_LEVEL];
@@ -99,17 +264,28 @@ void delete(skip_list *list, int key) {
     p = p -> forward[0];
     if (p && p -> key == key) {
         for (int i = 0; i <= list -> level; i++) {
-            if (update[i] -> forward[i] != p)
-                break;
-            update[i] -> forward[i] = p -> forward[i];
+            if (i < p -> level) {
+                SPAN(update[i])[i] += SPAN(p)[i] - 1;
+                update[i] -> forward[i] = p -> forward[i];
+            } else {
+                SPAN(update[i])[i]--;
+            }
         }
-        free(p);
+        pool_free(&list -> nodes[p -> level - 1], p);
+        list -> count--;
 
         while (list -> level > 0 && list -> header -> forward[list -> level] == NULL)
             list -> level--;
     }
 }
 
+// free every node at once, then the list itself
+void destroy_skip_list(skip_list *list) {
+    for (int i = 0; i < MAX_LEVEL; i++)
+        pool_destroy(&list -> nodes[i]);
+    free(list);
+}
+
 // display list
 void display(skip_list *list) {
     printf("\nSkip List:\n");
@@ -124,8 +300,1627 @@ void display(skip_list *list) {
     }
 }
 
-int main() {
-    srand(time(0));
+// Lock-free skip list (Fraser; Herlihy & Shavit). Forward pointers are
+// words whose low bit marks the node as deleted at that level. A delete
+// marks the victim's levels top-down, and whoever marks level 0 owns the
+// delete; any traversal that meets a marked node unlinks it with CAS.
+// Unlinked nodes go to per-thread limbo lists and are reused once no
+// thread can still hold a pointer to them (see lf_enter). A node always
+// goes back to the pool of the thread that allocated it: pools are not
+// thread-safe, so nodes retired by another thread are handed to their
+// owner through its returned stack and freed by the owner itself.
+
+#define MAX_THREADS 128
+#define EPOCH_IDLE ULONG_MAX
+#define ADVANCE_EVERY 64        // operations between attempts to advance the epoch
+
+#define MARKED(p) ((p) & 1)
+#define PTR(p) ((lf_node *) ((p) & ~(uintptr_t) 1))
+
+typedef struct lf_node {
+    int key;
+    int level;
+    atomic_int done;                // inserter and deleter finished with it
+    struct lf_thread *owner;        // whose pool the node came from
+    _Atomic(uintptr_t) next[];      // successor per level, low bit: deleted
+} lf_node;
+
+// Nodes retired during one epoch
+typedef struct limbo_list {
+    lf_node **items;
+    size_t count, cap;
+    unsigned long epoch;
+} limbo_list;
+
+// Per-thread state: epoch announcement, node pools and limbo lists
+typedef struct lf_thread {
+    atomic_ulong epoch;             // epoch entered, or EPOCH_IDLE
+    unsigned long seen;             // last epoch this thread entered in
+    unsigned ops;
+    pool nodes[MAX_LEVEL];
+    limbo_list limbo[4];            // retired in epoch e lives in limbo[e % 4]
+    _Atomic(lf_node *) returned;    // reclaimed by other threads, linked by next[0]
+} __attribute__((aligned(64))) lf_thread;
+
+typedef struct lf_skip_list {
+    lf_node *header;
+    atomic_int level;               // highest level any insert has used
+    atomic_ulong epoch;
+    atomic_int nthreads;
+    _Atomic(lf_thread *) threads[MAX_THREADS];
+} lf_skip_list;
+
+lf_skip_list *lf_create(void) {
+    lf_skip_list *list = (lf_skip_list *) malloc(sizeof(lf_skip_list));
+    list -> header = (lf_node *) calloc(1, sizeof(lf_node) + MAX_LEVEL * sizeof(uintptr_t));
+    list -> header -> key = INT_MIN;
+    list -> header -> level = MAX_LEVEL;
+    atomic_init(&list -> level, 0);
+    atomic_init(&list -> epoch, 0);
+    atomic_init(&list -> nthreads, 0);
+    for (int i = 0; i < MAX_THREADS; i++)
+        atomic_init(&list -> threads[i], NULL);
+    return list;
+}
+
+// Register the calling thread; the state lives until lf_destroy
+lf_thread *lf_register(lf_skip_list *list) {
+    int slot = atomic_fetch_add(&list -> nthreads, 1);
+    if (slot >= MAX_THREADS) {
+        fprintf(stderr, "lf_skip_list: more than %d threads\n", MAX_THREADS);
+        exit(1);
+    }
+    lf_thread *t = (lf_thread *) aligned_alloc(64, sizeof(lf_thread));
+    memset(t, 0, sizeof(lf_thread));
+    atomic_init(&t -> epoch, EPOCH_IDLE);
+    atomic_init(&t -> returned, NULL);
+    for (int i = 0; i < MAX_LEVEL; i++)
+        pool_init(&t -> nodes[i], sizeof(lf_node) + (i + 1) * sizeof(uintptr_t));
+    atomic_store(&list -> threads[slot], t);
+    return t;
+}
+
+// Free the nodes of a limbo list: own nodes straight into the pools,
+// other threads' nodes onto their owner's returned stack
+void free_limbo(lf_thread *t, limbo_list *l) {
+    for (size_t i = 0; i < l -> count; i++) {
+        lf_node *n = l -> items[i];
+        lf_thread *owner = n -> owner;
+        if (owner == t) {
+            pool_free(&t -> nodes[n -> level - 1], n);
+            continue;
+        }
+        lf_node *head = atomic_load(&owner -> returned);
+        do
+            atomic_store_explicit(&n -> next[0], (uintptr_t) head, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak(&owner -> returned, &head, n));
+    }
+    l -> count = 0;
+}
+
+// Take back the nodes other threads have handed to t. Only the owner pops,
+// and it takes the whole stack at once, so there is no ABA.
+void free_returned(lf_thread *t) {
+    lf_node *n = atomic_exchange(&t -> returned, NULL);
+    while (n) {
+        lf_node *next = (lf_node *) atomic_load_explicit(&n -> next[0], memory_order_relaxed);
+        pool_free(&t -> nodes[n -> level - 1], n);
+        n = next;
+    }
+}
+
+// Advance the epoch if every active thread has caught up with it
+void try_advance(lf_skip_list *list) {
+    unsigned long e = atomic_load(&list -> epoch);
+    int n = atomic_load(&list -> nthreads);
+    for (int i = 0; i < n && i < MAX_THREADS; i++) {
+        lf_thread *t = atomic_load(&list -> threads[i]);
+        unsigned long r = t ? atomic_load(&t -> epoch) : EPOCH_IDLE;
+        if (r != EPOCH_IDLE && r != e)
+            return;
+    }
+    atomic_compare_exchange_strong(&list -> epoch, &e, e + 1);
+}
+
+// Enter an operation. A node retired by a thread in epoch e may be
+// unlinked after the epoch has moved to e + 1, so threads that entered
+// in e + 1 can still hold it; once the epoch reaches e + 3 all of them
+// have left and the node goes back to the pools.
+void lf_enter(lf_skip_list *list, lf_thread *t) {
+    if (++t -> ops % ADVANCE_EVERY == 0)
+        try_advance(list);
+
+    unsigned long e = atomic_load(&list -> epoch);
+    atomic_store(&t -> epoch, e);
+    if (e != t -> seen) {
+        for (int i = 0; i < 4; i++)
+            if (t -> limbo[i].epoch + 3 <= e)
+                free_limbo(t, &t -> limbo[i]);
+        free_returned(t);
+        t -> seen = e;
+    }
+}
+
+void lf_exit(lf_thread *t) {
+    atomic_store_explicit(&t -> epoch, EPOCH_IDLE, memory_order_release);
+}
+
+void retire(lf_thread *t, lf_node *n) {
+    limbo_list *l = &t -> limbo[t -> seen % 4];
+    l -> epoch = t -> seen;     // any older contents were freed on entry
+    if (l -> count == l -> cap) {
+        l -> cap = l -> cap ? 2 * l -> cap : 256;
+        l -> items = (lf_node **) realloc(l -> items, l -> cap * sizeof(lf_node *));
+    }
+    l -> items[l -> count++] = n;
+}
+
+// Fill preds/succs with the nodes around key on every level in use,
+// unlinking marked nodes on the way. Returns 1 if an unmarked node with
+// key is linked at level 0 (it is then succs[0]).
+int lf_find(lf_skip_list *list, int key, lf_node **preds, lf_node **succs) {
+retry:;
+    lf_node *pred = list -> header, *curr = NULL;
+    for (int i = atomic_load(&list -> level); i >= 0; i--) {
+        curr = PTR(atomic_load(&pred -> next[i]));
+        while (curr) {
+            uintptr_t succ = atomic_load(&curr -> next[i]);
+            while (MARKED(succ)) {
+                uintptr_t expect = (uintptr_t) curr;
+                if (!atomic_compare_exchange_strong(&pred -> next[i], &expect, succ & ~(uintptr_t) 1))
+                    goto retry;
+                curr = PTR(succ);
+                if (!curr)
+                    break;
+                succ = atomic_load(&curr -> next[i]);
+            }
+            if (!curr || curr -> key >= key)
+                break;
+            pred = curr;
+            curr = PTR(succ);
+        }
+        preds[i] = pred;
+        succs[i] = curr;
+    }
+    return curr && curr -> key == key;
+}
+
+// Unlink the fully marked node n from every level. lf_find alone is not
+// enough: it stops at the first node with n's key, and a later insert of
+// the same key may have linked itself in front of n on an upper level
+// (pred -> new -> n). Each level is therefore walked past nodes with n's
+// key until n itself, unlinking any marked node met on the way.
+void lf_unlink(lf_skip_list *list, lf_node *n) {
+    lf_node *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+retry:
+    lf_find(list, n -> key, preds, succs);
+    for (int i = n -> level - 1; i >= 0; i--) {
+        lf_node *pred = preds[i];
+        uintptr_t p = atomic_load(&pred -> next[i]);
+        for (;;) {
+            lf_node *curr = PTR(p);
+            if (!curr || curr -> key > n -> key)
+                break;              // n is not linked on this level
+            uintptr_t succ = atomic_load(&curr -> next[i]);
+            if (curr == n || MARKED(succ)) {
+                uintptr_t expect = (uintptr_t) curr;
+                if (!atomic_compare_exchange_strong(&pred -> next[i], &expect, succ & ~(uintptr_t) 1))
+                    goto retry;
+                if (curr == n)
+                    break;
+                p = succ & ~(uintptr_t) 1;
+                continue;
+            }
+            pred = curr;
+            p = succ;
+        }
+    }
+}
+
+// Both the inserter (done linking) and the deleter (done marking) call
+// this; the second one unlinks the node for good and retires it, so a
+// node is never retired while an insert can still link it somewhere.
+void lf_finish(lf_skip_list *list, lf_thread *t, lf_node *n) {
+    if (atomic_fetch_add(&n -> done, 1) == 1) {
+        lf_unlink(list, n);
+        retire(t, n);
+    }
+}
+
+// Insert key; returns 1 if it was added, 0 if already present
+int lf_insert(lf_skip_list *list, lf_thread *t, int key) {
+    lf_node *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+    int top = random_level(MAX_LEVEL);
+    int level = atomic_load(&list -> level);
+    while (level < top && !atomic_compare_exchange_weak(&list -> level, &level, top))
+        ;
+
+    lf_enter(list, t);
+    lf_node *n = NULL;
+    for (;;) {
+        if (lf_find(list, key, preds, succs)) {
+            pool_free(&t -> nodes[top], n);
+            lf_exit(t);
+            return 0;
+        }
+        if (!n) {
+            n = (lf_node *) pool_alloc(&t -> nodes[top]);
+            n -> key = key;
+            n -> level = top + 1;
+            n -> owner = t;
+            atomic_init(&n -> done, 0);
+        }
+        for (int i = 0; i <= top; i++)
+            atomic_init(&n -> next[i], (uintptr_t) succs[i]);
+        uintptr_t expect = (uintptr_t) succs[0];
+        if (atomic_compare_exchange_strong(&preds[0] -> next[0], &expect, (uintptr_t) n))
+            break;
+    }
+
+    // Linked at level 0: the key is in. Link the upper levels, giving up
+    // as soon as a concurrent delete has marked the node.
+    for (int i = 1; i <= top; i++) {
+        for (;;) {
+            uintptr_t next = atomic_load(&n -> next[i]);
+            if (MARKED(next))
+                goto done;
+            if (PTR(next) != succs[i] &&
+                !atomic_compare_exchange_strong(&n -> next[i], &next, (uintptr_t) succs[i]))
+                continue;
+            uintptr_t expect = (uintptr_t) succs[i];
+            if (atomic_compare_exchange_strong(&preds[i] -> next[i], &expect, (uintptr_t) n))
+                break;
+            lf_find(list, key, preds, succs);
+        }
+    }
+done:
+    lf_finish(list, t, n);
+    lf_exit(t);
+    return 1;
+}
+
+// Delete key; returns 1 if this call removed it
+int lf_delete(lf_skip_list *list, lf_thread *t, int key) {
+    lf_node *preds[MAX_LEVEL], *succs[MAX_LEVEL];
+    lf_enter(list, t);
+    if (!lf_find(list, key, preds, succs)) {
+        lf_exit(t);
+        return 0;
+    }
+
+    lf_node *victim = succs[0];
+    for (int i = victim -> level - 1; i >= 1; i--) {
+        uintptr_t next = atomic_load(&victim -> next[i]);
+        while (!MARKED(next) && !atomic_compare_exchange_weak(&victim -> next[i], &next, next | 1))
+            ;
+    }
+    uintptr_t next = atomic_load(&victim -> next[0]);
+    for (;;) {
+        if (MARKED(next)) {     // another delete got there first
+            lf_exit(t);
+            return 0;
+        }
+        if (atomic_compare_exchange_weak(&victim -> next[0], &next, next | 1))
+            break;
+    }
+
+    lf_finish(list, t, victim);
+    lf_exit(t);
+    return 1;
+}
+
+// Lock-free membership test that never writes to the list: marked nodes
+// are skipped, not unlinked
+int lf_contains(lf_skip_list *list, lf_thread *t, int key) {
+    lf_enter(list, t);
+    lf_node *pred = list -> header, *curr = NULL;
+    for (int i = atomic_load(&list -> level); i >= 0; i--) {
+        curr = PTR(atomic_load(&pred -> next[i]));
+        while (curr) {
+            uintptr_t succ = atomic_load(&curr -> next[i]);
+            while (MARKED(succ)) {
+                curr = PTR(succ);
+                if (!curr)
+                    break;
+                succ = atomic_load(&curr -> next[i]);
+            }
+            if (!curr || curr -> key >= key)
+                break;
+            pred = curr;
+            curr = PTR(succ);
+        }
+    }
+    int found = curr && curr -> key == key;
+    lf_exit(t);
+    return found;
+}
+
+// Free every node and every thread's state; no thread may still use the list
+void lf_destroy(lf_skip_list *list) {
+    int n = atomic_load(&list -> nthreads);
+    for (int i = 0; i < n && i < MAX_THREADS; i++) {
+        lf_thread *t = atomic_load(&list -> threads[i]);
+        for (int j = 0; j < MAX_LEVEL; j++)
+            pool_destroy(&t -> nodes[j]);
+        for (int j = 0; j < 4; j++)
+            free(t -> limbo[j].items);
+        free(t);
+    }
+    free(list -> header);
+    free(list);
+}
+
+// Structural check of a quiescent lock-free list: every level sorted,
+// no marked node still linked, upper levels only hold tall enough nodes.
+// Returns the number of keys, or -1.
+long lf_check(lf_skip_list *list) {
+    long keys = 0;
+    for (int i = MAX_LEVEL - 1; i >= 0; i--) {
+        lf_node *prev = list -> header;
+        for (uintptr_t p = atomic_load(&list -> header -> next[i]); p; ) {
+            lf_node *n = PTR(p);
+            if (MARKED(p) || n -> key <= prev -> key || n -> level <= i)
+                return -1;
+            if (!i)
+                keys++;
+            prev = n;
+            p = atomic_load(&n -> next[i]);
+        }
+    }
+    return keys;
+}
+
+#define STRESS_KEYS 1024
+#define STRESS_HISTORY (1 << 19)    // operations recorded per thread
+#define STRESS_MAX_THREADS 31       // pending operations fit a config mask
+
+enum { OP_INSERT, OP_DELETE, OP_CONTAINS };
+
+// One completed operation. Invocation and response are stamped from one
+// shared counter, so a.response < b.invoke means a returned before b
+// started.
+typedef struct history_op {
+    uint32_t invoke, response;
+    uint16_t key;
+    uint8_t op, result;
+} history_op;
+
+typedef struct stress_worker {
+    lf_skip_list *list;
+    atomic_int *stop;
+    atomic_uint *clock;
+    int id;
+    long ops;
+    history_op *history;
+} stress_worker;
+
+// Keys divisible by 4 are inserted up front and never deleted, and keys
+// at or above STRESS_KEYS are never inserted; the rest churn under
+// inserts and deletes from every thread. Every operation is recorded.
+void *stress_thread(void *arg) {
+    stress_worker *w = (stress_worker *) arg;
+    lf_thread *t = lf_register(w -> list);
+    uint64_t seed = 1234 + w -> id;
+
+    while (w -> ops < STRESS_HISTORY && !atomic_load_explicit(w -> stop, memory_order_relaxed)) {
+        uint64_t r = bench_rand(&seed);
+        int key = (int) ((r >> 32) % STRESS_KEYS);
+        history_op *h = &w -> history[w -> ops++];
+        switch (r % 8) {
+        case 0:
+            key &= ~3;
+            h -> op = OP_CONTAINS;
+            break;
+        case 1:
+            key += STRESS_KEYS;
+            h -> op = OP_CONTAINS;
+            break;
+        case 2:
+            h -> op = OP_CONTAINS;
+            break;
+        case 3: case 4: case 5:
+            h -> op = OP_INSERT;
+            break;
+        default:
+            h -> op = OP_DELETE;
+        }
+        if (key < STRESS_KEYS && key % 4 == 0 && h -> op != OP_CONTAINS)
+            h -> op = OP_CONTAINS;  // stable keys are only searched
+        h -> key = (uint16_t) key;
+
+        h -> invoke = atomic_fetch_add(w -> clock, 1);
+        if (h -> op == OP_INSERT)
+            h -> result = (uint8_t) lf_insert(w -> list, t, key);
+        else if (h -> op == OP_DELETE)
+            h -> result = (uint8_t) lf_delete(w -> list, t, key);
+        else
+            h -> result = (uint8_t) lf_contains(w -> list, t, key);
+        h -> response = atomic_fetch_add(w -> clock, 1);
+    }
+    return NULL;
+}
+
+// Apply op to a set member in state present; returns the new state, or
+// -1 if op could not have returned its result from that state
+int set_step(const history_op *h, int present) {
+    switch (h -> op) {
+    case OP_INSERT:
+        return h -> result == !present ? 1 : -1;
+    case OP_DELETE:
+        return h -> result == present ? 0 : -1;
+    default:
+        return h -> result == present ? present : -1;
+    }
+}
+
+typedef struct history_event {
+    uint32_t time;
+    int thread;                 // -1 - thread for a response
+    const history_op *op;
+} history_event;
+
+int compare_event(const void *a, const void *b) {
+    uint32_t x = ((const history_event *) a) -> time, y = ((const history_event *) b) -> time;
+    return (x > y) - (x < y);
+}
+
+// Add config c (bit 0: present, bit 1 + i: pending op of thread i already
+// linearized) unless it is there already
+void add_config(uint32_t *configs, int *n, uint32_t c) {
+    for (int i = 0; i < *n; i++)
+        if (configs[i] == c)
+            return;
+    configs[(*n)++] = c;
+}
+
+// Decide whether one key's history is linearizable for a set, starting
+// from present. Events are replayed in time order while tracking every
+// configuration the object could be in: before a response, pending
+// operations are linearized in every order the states allow, and then
+// only configurations that include the responding operation survive.
+// Returns the possible final states as a bit set (bit s: state s
+// possible), 0 if the history is not linearizable.
+int check_key(history_event *ev, size_t n, int present, int threads) {
+    const history_op *pending[STRESS_MAX_THREADS] = {0};
+    // A truncated closure can only cause false alarms, never hide a bug
+    int cap = threads < 11 ? 2 << threads : 4096;
+    uint32_t *configs = (uint32_t *) malloc(cap * sizeof(uint32_t));
+    uint32_t *next = (uint32_t *) malloc(cap * sizeof(uint32_t));
+    int count = 1, finals = 0;
+    configs[0] = (uint32_t) present;
+
+    qsort(ev, n, sizeof(history_event), compare_event);
+    for (size_t e = 0; e < n && count; e++) {
+        if (ev[e].thread >= 0) {
+            pending[ev[e].thread] = ev[e].op;
+            continue;
+        }
+        int th = -1 - ev[e].thread;
+
+        // Closure: extend every configuration by any pending operation
+        for (int i = 0; i < count && count < cap; i++) {
+            for (int j = 0; j < threads; j++) {
+                uint32_t bit = 2u << j;
+                if (!pending[j] || (configs[i] & bit))
+                    continue;
+                int s = set_step(pending[j], (int) (configs[i] & 1));
+                if (s >= 0 && count < cap)
+                    add_config(configs, &count, ((configs[i] | bit) & ~1u) | (uint32_t) s);
+            }
+        }
+
+        // The responding operation must have taken effect by now
+        int kept = 0;
+        uint32_t bit = 2u << th;
+        for (int i = 0; i < count; i++)
+            if (configs[i] & bit)
+                add_config(next, &kept, configs[i] & ~bit);
+        uint32_t *swap = configs;
+        configs = next;
+        next = swap;
+        count = kept;
+        pending[th] = NULL;
+    }
+    for (int i = 0; i < count; i++)
+        finals |= 1 << (configs[i] & 1);
+    free(configs);
+    free(next);
+    return finals;
+}
+
+// Run threads against the list for the given time (or until a history is
+// full), then check each key's history separately: a set is the product
+// of independent per-key members, so the whole history is linearizable
+// exactly when every per-key history is (P-compositionality). Each
+// per-key check also has to agree with the key's presence at the end.
+int stress(int threads, double seconds) {
+    if (threads > STRESS_MAX_THREADS)
+        threads = STRESS_MAX_THREADS;
+    lf_skip_list *list = lf_create();
+    lf_thread *main_thread = lf_register(list);
+    for (int k = 0; k < STRESS_KEYS; k += 4)
+        lf_insert(list, main_thread, k);
+
+    atomic_int stop;
+    atomic_uint clock;
+    atomic_init(&stop, 0);
+    atomic_init(&clock, 0);
+    pthread_t tid[threads];
+    stress_worker *w = (stress_worker *) calloc(threads, sizeof(stress_worker));
+    for (int i = 0; i < threads; i++) {
+        w[i].list = list;
+        w[i].stop = &stop;
+        w[i].clock = &clock;
+        w[i].id = i;
+        w[i].history = (history_op *) malloc(STRESS_HISTORY * sizeof(history_op));
+        pthread_create(&tid[i], NULL, stress_thread, &w[i]);
+    }
+    struct timespec pause = {(time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9)};
+    nanosleep(&pause, NULL);
+    atomic_store(&stop, 1);
+    for (int i = 0; i < threads; i++)
+        pthread_join(tid[i], NULL);
+
+    // Bucket the events by key, each thread's in program order
+    size_t *start = (size_t *) calloc(2 * STRESS_KEYS + 1, sizeof(size_t));
+    long ops = 0;
+    for (int i = 0; i < threads; i++) {
+        ops += w[i].ops;
+        for (long j = 0; j < w[i].ops; j++)
+            start[w[i].history[j].key + 1] += 2;
+    }
+    for (int k = 0; k < 2 * STRESS_KEYS; k++)
+        start[k + 1] += start[k];
+    history_event *ev = (history_event *) malloc((start[2 * STRESS_KEYS] + 1) * sizeof(history_event));
+    size_t *fill = (size_t *) malloc(2 * STRESS_KEYS * sizeof(size_t));
+    memcpy(fill, start, 2 * STRESS_KEYS * sizeof(size_t));
+    for (int i = 0; i < threads; i++) {
+        for (long j = 0; j < w[i].ops; j++) {
+            const history_op *h = &w[i].history[j];
+            ev[fill[h -> key]++] = (history_event) {h -> invoke, i, h};
+            ev[fill[h -> key]++] = (history_event) {h -> response, -1 - i, h};
+        }
+    }
+
+    long bad_keys = 0, present = 0;
+    int first_bad = -1;
+    for (int k = 0; k < 2 * STRESS_KEYS; k++) {
+        int initial = k < STRESS_KEYS && k % 4 == 0;
+        int finals = check_key(ev + start[k], start[k + 1] - start[k], initial, threads);
+        int found = lf_contains(list, main_thread, k);
+        present += found;
+        if (!(finals & (1 << found))) {
+            if (first_bad < 0)
+                first_bad = k;
+            bad_keys++;
+        }
+    }
+    long linked = lf_check(list);
+
+    printf("%d threads, %ld operations: %ld of %d keys not linearizable", threads, ops,
+           bad_keys, 2 * STRESS_KEYS);
+    if (bad_keys)
+        printf(" (first: %d)", first_bad);
+    printf(", structure %s (%ld linked, %ld present)\n",
+           linked == present ? "ok" : "CORRUPT", linked, present);
+
+    for (int i = 0; i < threads; i++)
+        free(w[i].history);
+    free(w);
+    free(start);
+    free(fill);
+    free(ev);
+    lf_destroy(list);
+    return bad_keys || linked != present;
+}
+
+typedef struct mixed_worker {
+    lf_skip_list *list;
+    int id, reads;      // percent of operations that are searches
+    long ops, range;
+} mixed_worker;
+
+void *mixed_thread(void *arg) {
+    mixed_worker *w = (mixed_worker *) arg;
+    lf_thread *t = lf_register(w -> list);
+    uint64_t seed = 99 + w -> id;
+    for (long i = 0; i < w -> ops; i++) {
+        uint64_t r = bench_rand(&seed);
+        int key = (int) ((r >> 32) % w -> range);
+        int op = (int) (r % 100);
+        if (op < w -> reads)
+            lf_contains(w -> list, t, key);
+        else if ((op - w -> reads) % 2)
+            lf_insert(w -> list, t, key);
+        else
+            lf_delete(w -> list, t, key);
+    }
+    return NULL;
+}
+
+// Throughput of mixed workloads on a list holding about keys/2 of keys
+// distinct keys, from 1 thread up to max_threads
+int bench_concurrent(int max_threads, long keys) {
+    int reads[] = {90, 50};
+    for (int w = 0; w < 2; w++) {
+        printf("%d%% search, %d%% insert, %d%% delete:\n", reads[w], (100 - reads[w]) / 2,
+               (100 - reads[w]) / 2);
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            lf_skip_list *list = lf_create();
+            lf_thread *main_thread = lf_register(list);
+            uint64_t seed = 7;
+            for (long i = 0; i < keys / 2; i++)
+                lf_insert(list, main_thread, (int) ((bench_rand(&seed) >> 32) % keys));
+
+            long total = 2000000;
+            pthread_t tid[threads];
+            mixed_worker mw[threads];
+            double t = now_sec();
+            for (int i = 0; i < threads; i++) {
+                mw[i] = (mixed_worker) {list, i, reads[w], total / threads, keys};
+                pthread_create(&tid[i], NULL, mixed_thread, &mw[i]);
+            }
+            for (int i = 0; i < threads; i++)
+                pthread_join(tid[i], NULL);
+            double elapsed = now_sec() - t;
+
+            printf("  %2d threads: %.2f M ops/s%s\n", threads, total / elapsed / 1e6,
+                   lf_check(list) < 0 ? "  CORRUPT" : "");
+            lf_destroy(list);
+        }
+    }
+    return 0;
+}
+
+// Key-value store on top of the skip list (a small LSM tree). Writes are
+// appended to a write-ahead log and applied to the memtable, a skip_list
+// whose nodes carry values. Once the memtable holds mem_limit keys it is
+// frozen, a fresh memtable and log take over, and the frozen one is
+// written out as an immutable sorted run without holding the store lock.
+// Lookups check the memtable, the frozen memtable and then the runs,
+// newest first. A background thread merges runs size-tiered: COMPACT_AT
+// adjacent runs of one tier become one run of the next tier, so every
+// entry is rewritten about log_COMPACT_AT(flushes) times, not on every
+// compaction.
+//
+// Every file in the store directory is named by one increasing id:
+//   wal-<id>.log   writes since the memtable was last flushed
+//   run-<id>.sst   the flushed contents of wal-<id>.log, or the merge of
+//                  every run from footer.first_id up to id; the number of
+//                  logs it covers gives its tier
+
+#define TOMBSTONE INT_MIN       // value of a deleted key; not a valid value
+#define RUN_BLOCK 128           // entries per sparse-index entry
+#define BLOOM_BITS_PER_KEY 10
+#define BLOOM_HASHES 7          // about 1% false positives at 10 bits per key
+#define MAX_RUNS 64             // flushes wait for compaction beyond this
+#define COMPACT_AT 4            // runs of one tier merged together
+#define RUN_MAGIC 0x4E55524Bu   // "KRUN"
+
+typedef struct kv_entry {
+    int key;
+    int value;
+} kv_entry;
+
+// One log record; check guards against a torn or zeroed tail
+typedef struct wal_record {
+    uint32_t check;
+    int key;
+    int value;
+} wal_record;
+
+// Run file: kv_entry[count] sorted by key, then the first key of every
+// RUN_BLOCK entries (padded to an even count, keeping the filter 8-byte
+// aligned), then the Bloom filter words, then this footer
+typedef struct run_footer {
+    uint64_t count;
+    uint64_t bloom_words;
+    uint64_t first_id;          // oldest id merged into this run
+    uint32_t magic;
+    uint32_t version;
+} run_footer;
+
+typedef struct run {
+    uint64_t id, first_id;
+    const kv_entry *entries;
+    const int *index;
+    const uint64_t *bloom;
+    size_t count, blocks, bloom_bits;
+    void *map;
+    size_t map_size;
+} run;
+
+typedef struct kv_store {
+    char dir[PATH_MAX - 32];
+    uint64_t next_id;
+
+    // memtable and log, under lock
+    pthread_mutex_t lock;
+    pthread_cond_t synced;      // a sync or a flush finished
+    skip_list *mem;
+    size_t mem_limit;
+    int wal_fd;
+    uint64_t wal_id;
+    skip_list *imm;             // frozen memtable being flushed, or NULL
+    uint64_t imm_id, imm_first_id;
+    wal_record *buf, *spare;    // records waiting for the next sync
+    size_t buf_len, buf_cap, spare_cap;
+    uint64_t appended, durable; // log sequence numbers
+    int syncing;
+    size_t fsyncs;
+
+    // sorted runs, oldest first, under runs_lock (taken after lock)
+    pthread_mutex_t runs_lock;
+    pthread_cond_t runs_changed;
+    run *runs[MAX_RUNS];
+    int nruns;
+    pthread_t compactor;
+    int stop;
+    size_t compactions, compacted; // merges, and entries they wrote
+
+    atomic_long lookups, runs_probed, blocks_read;
+} kv_store;
+
+void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+void write_full(int fd, const void *buf, size_t bytes) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t w = write(fd, (const char *) buf + done, bytes - done);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w < 0)
+            die("write");
+        done += w;
+    }
+}
+
+void kv_path(kv_store *kv, char *out, const char *kind, uint64_t id, const char *ext) {
+    snprintf(out, PATH_MAX, "%s/%s-%06" PRIu64 "%s", kv -> dir, kind, id, ext);
+}
+
+void sync_dir(kv_store *kv) {
+    int fd = open(kv -> dir, O_RDONLY);
+    if (fd < 0 || fsync(fd) < 0)
+        die(kv -> dir);
+    close(fd);
+}
+
+// splitmix64 finalizer, for Bloom probes and record checks
+uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+uint32_t wal_check(int key, int value) {
+    return (uint32_t) (mix64((uint64_t) (uint32_t) key << 32 | (uint32_t) value) >> 32);
+}
+
+// Bloom probes by double hashing: bit i is h1 + i * h2
+int bloom_test(const uint64_t *bloom, size_t bits, int key, int set) {
+    uint64_t h = mix64((uint32_t) key);
+    uint64_t h1 = (uint32_t) h, h2 = (h >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        size_t bit = (h1 + i * h2) % bits;
+        if (set)
+            ((uint64_t *) bloom)[bit / 64] |= 1ULL << (bit % 64);
+        else if (!(bloom[bit / 64] >> (bit % 64) & 1))
+            return 0;
+    }
+    return 1;
+}
+
+// Streams sorted entries into a new run file
+typedef struct run_writer {
+    FILE *f;
+    size_t count;
+    int *index;
+    size_t index_cap;
+    uint64_t *bloom;
+    size_t bloom_words;
+} run_writer;
+
+// expected bounds the number of entries, which sizes the Bloom filter
+void run_writer_open(run_writer *w, const char *path, size_t expected) {
+    w -> f = fopen(path, "wb");
+    if (!w -> f)
+        die(path);
+    setvbuf(w -> f, NULL, _IOFBF, 1 << 20);
+    w -> count = 0;
+    w -> index_cap = expected / RUN_BLOCK + 1;
+    w -> index = (int *) malloc(w -> index_cap * sizeof(int));
+    w -> bloom_words = (expected * BLOOM_BITS_PER_KEY + 63) / 64 + 1;
+    w -> bloom = (uint64_t *) calloc(w -> bloom_words, sizeof(uint64_t));
+}
+
+void run_writer_add(run_writer *w, int key, int value) {
+    if (w -> count % RUN_BLOCK == 0) {
+        if (w -> count / RUN_BLOCK == w -> index_cap) {
+            w -> index_cap *= 2;
+            w -> index = (int *) realloc(w -> index, w -> index_cap * sizeof(int));
+        }
+        w -> index[w -> count / RUN_BLOCK] = key;
+    }
+    kv_entry e = {key, value};
+    fwrite(&e, sizeof(e), 1, w -> f);
+    bloom_test(w -> bloom, w -> bloom_words * 64, key, 1);
+    w -> count++;
+}
+
+// Append index, filter and footer, make the file durable and move it to
+// its final name (atomically replacing any file already there)
+void run_writer_close(run_writer *w, kv_store *kv, const char *tmp, const char *path,
+                      uint64_t first_id) {
+    run_footer footer = {w -> count, w -> bloom_words, first_id, RUN_MAGIC, 2};
+    size_t blocks = (w -> count + RUN_BLOCK - 1) / RUN_BLOCK;
+    int pad = 0;
+    fwrite(w -> index, sizeof(int), blocks, w -> f);
+    fwrite(&pad, sizeof(int), blocks % 2, w -> f);
+    fwrite(w -> bloom, sizeof(uint64_t), w -> bloom_words, w -> f);
+    fwrite(&footer, sizeof(footer), 1, w -> f);
+    if (fflush(w -> f) || ferror(w -> f) || fsync(fileno(w -> f)) < 0)
+        die(tmp);
+    fclose(w -> f);
+    if (rename(tmp, path) < 0)
+        die(path);
+    sync_dir(kv);
+    free(w -> index);
+    free(w -> bloom);
+}
+
+// Map a run file; NULL if it is missing or malformed
+run *load_run(const char *path, uint64_t id) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(run_footer)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    run_footer f;
+    memcpy(&f, (char *) map + st.st_size - sizeof(f), sizeof(f));
+    size_t blocks = (f.count + RUN_BLOCK - 1) / RUN_BLOCK;
+    if (f.magic != RUN_MAGIC || f.version != 2 ||
+        f.count * sizeof(kv_entry) + (blocks + blocks % 2) * sizeof(int) +
+        f.bloom_words * sizeof(uint64_t) + sizeof(f) != (size_t) st.st_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    run *r = (run *) malloc(sizeof(run));
+    r -> id = id;
+    r -> first_id = f.first_id;
+    r -> count = f.count;
+    r -> blocks = blocks;
+    r -> entries = (const kv_entry *) map;
+    r -> index = (const int *) (r -> entries + f.count);
+    r -> bloom = (const uint64_t *) ((const char *) map + st.st_size - sizeof(f) -
+                                     f.bloom_words * sizeof(uint64_t));
+    r -> bloom_bits = f.bloom_words * 64;
+    r -> map = map;
+    r -> map_size = st.st_size;
+    return r;
+}
+
+void free_run(run *r) {
+    munmap(r -> map, r -> map_size);
+    free(r);
+}
+
+// Look key up in one run: the filter, then the sparse index, then one
+// block. Returns 1 and sets value if the run has the key.
+int run_get(kv_store *kv, run *r, int key, int *value) {
+    if (!r -> count || !bloom_test(r -> bloom, r -> bloom_bits, key, 0))
+        return 0;
+    atomic_fetch_add_explicit(&kv -> runs_probed, 1, memory_order_relaxed);
+
+    // last block starting at or before key
+    size_t lo = 0, hi = r -> blocks;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (r -> index[mid] <= key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo)
+        return 0;
+    atomic_fetch_add_explicit(&kv -> blocks_read, 1, memory_order_relaxed);
+
+    lo = (lo - 1) * RUN_BLOCK;
+    hi = lo + RUN_BLOCK < r -> count ? lo + RUN_BLOCK : r -> count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (r -> entries[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == r -> count || r -> entries[lo].key != key)
+        return 0;
+    *value = r -> entries[lo].value;
+    return 1;
+}
+
+// Returns 1 and sets value if key is present
+int kv_get(kv_store *kv, int key, int *value) {
+    atomic_fetch_add_explicit(&kv -> lookups, 1, memory_order_relaxed);
+    int v = TOMBSTONE, found = 0;
+
+    pthread_mutex_lock(&kv -> lock);
+    node *n = search(kv -> mem, key);
+    if (!n && kv -> imm)
+        n = search(kv -> imm, key);
+    if (n) {
+        v = n -> value;
+        found = 1;
+    }
+    // take the runs before letting a flush move the memtable into them
+    pthread_mutex_lock(&kv -> runs_lock);
+    pthread_mutex_unlock(&kv -> lock);
+    for (int i = kv -> nruns - 1; i >= 0 && !found; i--)
+        found = run_get(kv, kv -> runs[i], key, &v);
+    pthread_mutex_unlock(&kv -> runs_lock);
+
+    if (!found || v == TOMBSTONE)
+        return 0;
+    *value = v;
+    return 1;
+}
+
+void open_wal(kv_store *kv) {
+    char path[PATH_MAX];
+    kv_path(kv, path, "wal", kv -> wal_id, ".log");
+    kv -> wal_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (kv -> wal_fd < 0)
+        die(path);
+    sync_dir(kv);
+}
+
+// Freeze the memtable for a flush covering logs first_id..wal id and
+// switch to a new memtable and log. Called with lock held, no sync in
+// flight and no flush running. Records still queued in buf go to the new
+// log with the next sync; replaying them over the run is harmless, as
+// they are the newest values of their keys in it.
+void begin_flush(kv_store *kv, uint64_t first_id) {
+    kv -> imm = kv -> mem;
+    kv -> imm_id = kv -> wal_id;
+    kv -> imm_first_id = first_id;
+    kv -> mem = create_skip_list();
+    close(kv -> wal_fd);
+    kv -> wal_id = kv -> next_id++;
+    open_wal(kv);
+}
+
+// Write the frozen memtable out as run-<imm id> with lock released; the
+// memtable is immutable and stays readable meanwhile. Then install the
+// run, drop the frozen memtable and delete the log it replaces.
+void finish_flush(kv_store *kv) {
+    char tmp[PATH_MAX], path[PATH_MAX];
+    kv_path(kv, tmp, "run", kv -> imm_id, ".tmp");
+    kv_path(kv, path, "run", kv -> imm_id, ".sst");
+    run_writer w;
+    run_writer_open(&w, tmp, kv -> imm -> count);
+    for (node *n = kv -> imm -> header -> forward[0]; n; n = n -> forward[0])
+        run_writer_add(&w, n -> key, n -> value);
+    run_writer_close(&w, kv, tmp, path, kv -> imm_first_id);
+    run *r = load_run(path, kv -> imm_id);
+    if (!r)
+        die(path);
+
+    // only flushes add runs and only one runs at a time, so the slot
+    // stays free until the run goes in below
+    pthread_mutex_lock(&kv -> runs_lock);
+    while (kv -> nruns == MAX_RUNS)
+        pthread_cond_wait(&kv -> runs_changed, &kv -> runs_lock);
+    pthread_mutex_unlock(&kv -> runs_lock);
+
+    pthread_mutex_lock(&kv -> lock);
+    pthread_mutex_lock(&kv -> runs_lock);
+    kv -> runs[kv -> nruns++] = r;
+    pthread_cond_broadcast(&kv -> runs_changed);
+    pthread_mutex_unlock(&kv -> runs_lock);
+    skip_list *imm = kv -> imm;
+    uint64_t imm_id = kv -> imm_id;
+    kv -> imm = NULL;
+    pthread_cond_broadcast(&kv -> synced);
+    pthread_mutex_unlock(&kv -> lock);
+
+    // lookups search imm under lock, so nobody can still be in it
+    destroy_skip_list(imm);
+    char wal[PATH_MAX];
+    kv_path(kv, wal, "wal", imm_id, ".log");
+    unlink(wal);
+}
+
+// Set key to value (TOMBSTONE deletes it); returns once the write is
+// durable. Writers that arrive while a sync is in flight queue behind it
+// and all go out together in the next one (group commit).
+void kv_put(kv_store *kv, int key, int value) {
+    pthread_mutex_lock(&kv -> lock);
+    if (kv -> buf_len == kv -> buf_cap) {
+        kv -> buf_cap = kv -> buf_cap ? 2 * kv -> buf_cap : 1024;
+        kv -> buf = (wal_record *) realloc(kv -> buf, kv -> buf_cap * sizeof(wal_record));
+    }
+    kv -> buf[kv -> buf_len++] = (wal_record) {wal_check(key, value), key, value};
+    uint64_t lsn = ++kv -> appended;
+    insert(kv -> mem, key) -> value = value;
+
+    while (kv -> durable < lsn) {
+        if (kv -> syncing) {
+            pthread_cond_wait(&kv -> synced, &kv -> lock);
+            continue;
+        }
+        // lead a sync of everything queued so far; new writers append to
+        // the other buffer meanwhile
+        wal_record *batch = kv -> buf;
+        size_t len = kv -> buf_len, cap = kv -> buf_cap;
+        uint64_t upto = kv -> appended;
+        kv -> buf = kv -> spare;
+        kv -> buf_cap = kv -> spare_cap;
+        kv -> spare = batch;
+        kv -> spare_cap = cap;
+        kv -> buf_len = 0;
+        kv -> syncing = 1;
+        pthread_mutex_unlock(&kv -> lock);
+
+        write_full(kv -> wal_fd, batch, len * sizeof(wal_record));
+        if (fdatasync(kv -> wal_fd) < 0)
+            die("fdatasync");
+
+        pthread_mutex_lock(&kv -> lock);
+        kv -> syncing = 0;
+        kv -> durable = upto;
+        kv -> fsyncs++;
+        pthread_cond_broadcast(&kv -> synced);
+    }
+
+    // the log cannot be switched under a sync and one flush runs at a
+    // time; recheck after waiting, as another writer may have flushed
+    while (kv -> mem -> count >= kv -> mem_limit && (kv -> syncing || kv -> imm))
+        pthread_cond_wait(&kv -> synced, &kv -> lock);
+    int flush = kv -> mem -> count >= kv -> mem_limit;
+    if (flush)
+        begin_flush(kv, kv -> wal_id);
+    pthread_mutex_unlock(&kv -> lock);
+    if (flush)
+        finish_flush(kv);
+}
+
+void kv_delete(kv_store *kv, int key) {
+    kv_put(kv, key, TOMBSTONE);
+}
+
+// Tier of a run: a flush covers one log, and merging COMPACT_AT runs of
+// tier t gives a run covering about COMPACT_AT^(t + 1) logs
+int run_tier(run *r) {
+    int tier = 0;
+    for (uint64_t logs = r -> id - r -> first_id + 1; logs >= COMPACT_AT; logs /= COMPACT_AT)
+        tier++;
+    return tier;
+}
+
+// Pick COMPACT_AT adjacent runs of one tier, preferring the newest (and
+// so smallest); returns the index of the first, or -1. Called under
+// runs_lock.
+int pick_compaction(kv_store *kv) {
+    int same = 0;
+    for (int i = kv -> nruns - 1; i >= 0; i--) {
+        same = i + 1 < kv -> nruns && run_tier(kv -> runs[i]) == run_tier(kv -> runs[i + 1]) ? same + 1 : 1;
+        if (same == COMPACT_AT)
+            return i;
+    }
+    return -1;
+}
+
+// Merge adjacent runs into one, newest value first. Tombstones are
+// dropped only when the oldest run is an input, as nothing older is left
+// for them to shadow.
+run *merge_runs(kv_store *kv, run **in, int n, int oldest) {
+    size_t pos[MAX_RUNS] = {0}, total = 0;
+    for (int i = 0; i < n; i++)
+        total += in[i] -> count;
+
+    char tmp[PATH_MAX], path[PATH_MAX];
+    uint64_t id = in[n - 1] -> id;
+    kv_path(kv, tmp, "run", id, ".tmp");
+    kv_path(kv, path, "run", id, ".sst");
+    run_writer w;
+    run_writer_open(&w, tmp, total);
+
+    for (;;) {
+        int best = -1;
+        for (int i = 0; i < n; i++)
+            if (pos[i] < in[i] -> count &&
+                (best < 0 || in[i] -> entries[pos[i]].key <= in[best] -> entries[pos[best]].key))
+                best = i;   // ties go to the later, newer run
+        if (best < 0)
+            break;
+        kv_entry e = in[best] -> entries[pos[best]];
+        for (int i = 0; i < n; i++)
+            if (pos[i] < in[i] -> count && in[i] -> entries[pos[i]].key == e.key)
+                pos[i]++;
+        if (e.value != TOMBSTONE || !oldest)
+            run_writer_add(&w, e.key, e.value);
+    }
+    // replaces the newest input's file; recovery drops the others by id
+    run_writer_close(&w, kv, tmp, path, in[0] -> first_id);
+    run *r = load_run(path, id);
+    if (!r)
+        die(path);
+    return r;
+}
+
+void *compact_thread(void *arg) {
+    kv_store *kv = (kv_store *) arg;
+    pthread_mutex_lock(&kv -> runs_lock);
+    for (;;) {
+        int first;
+        while (!kv -> stop && (first = pick_compaction(kv)) < 0)
+            pthread_cond_wait(&kv -> runs_changed, &kv -> runs_lock);
+        if (kv -> stop)
+            break;
+
+        int n = COMPACT_AT;
+        run *in[COMPACT_AT];
+        memcpy(in, kv -> runs + first, n * sizeof(run *));
+        pthread_mutex_unlock(&kv -> runs_lock);
+
+        run *out = merge_runs(kv, in, n, first == 0);
+
+        // only this thread removes runs, so the inputs are still at
+        // first; runs flushed meanwhile sit after them and stay newer
+        pthread_mutex_lock(&kv -> runs_lock);
+        kv -> runs[first] = out;
+        memmove(kv -> runs + first + 1, kv -> runs + first + n,
+                (kv -> nruns - first - n) * sizeof(run *));
+        kv -> nruns -= n - 1;
+        kv -> compactions++;
+        kv -> compacted += out -> count;
+        pthread_cond_broadcast(&kv -> runs_changed);
+        pthread_mutex_unlock(&kv -> runs_lock);
+
+        // readers probe runs under runs_lock, so the inputs are unused now
+        for (int i = 0; i < n; i++) {
+            if (in[i] -> id != out -> id) {
+                char path[PATH_MAX];
+                kv_path(kv, path, "run", in[i] -> id, ".sst");
+                unlink(path);
+            }
+            free_run(in[i]);
+        }
+        pthread_mutex_lock(&kv -> runs_lock);
+    }
+    pthread_mutex_unlock(&kv -> runs_lock);
+    return NULL;
+}
+
+int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Apply one log to the memtable; a torn tail is cut off. Returns the
+// number of records replayed.
+size_t replay_wal(kv_store *kv, const char *path) {
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        die(path);
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        die(path);
+    wal_record *recs = (wal_record *) malloc(st.st_size + 1);
+    size_t got = 0;
+    while (got < (size_t) st.st_size) {
+        ssize_t r = read(fd, (char *) recs + got, st.st_size - got);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            die(path);
+        got += r;
+    }
+
+    size_t n = got / sizeof(wal_record), i = 0;
+    for (; i < n && recs[i].check == wal_check(recs[i].key, recs[i].value); i++)
+        insert(kv -> mem, recs[i].key) -> value = recs[i].value;
+    if (i * sizeof(wal_record) != got && ftruncate(fd, i * sizeof(wal_record)) < 0)
+        die(path);
+    close(fd);
+    free(recs);
+    return i;
+}
+
+// Open (or create) the store in dir and recover it: load the runs, drop
+// runs a finished compaction replaced, and replay the logs that were never
+// flushed into the memtable
+kv_store *kv_open(const char *dir, size_t mem_limit) {
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+        die(dir);
+    kv_store *kv = (kv_store *) calloc(1, sizeof(kv_store));
+    snprintf(kv -> dir, sizeof(kv -> dir), "%s", dir);
+    pthread_mutex_init(&kv -> lock, NULL);
+    pthread_cond_init(&kv -> synced, NULL);
+    pthread_mutex_init(&kv -> runs_lock, NULL);
+    pthread_cond_init(&kv -> runs_changed, NULL);
+    kv -> mem = create_skip_list();
+    kv -> mem_limit = mem_limit;
+
+    uint64_t run_ids[MAX_RUNS * 2], wal_ids[MAX_RUNS];
+    int nrun_ids = 0, nwal_ids = 0;
+    DIR *d = opendir(dir);
+    if (!d)
+        die(dir);
+    struct dirent *e;
+    char path[PATH_MAX];
+    while ((e = readdir(d))) {
+        uint64_t id;
+        char ext[8];
+        if (sscanf(e -> d_name, "run-%" SCNu64 ".%7s", &id, ext) == 2) {
+            if (!strcmp(ext, "tmp")) {
+                snprintf(path, sizeof(path), "%s/%s", dir, e -> d_name);
+                unlink(path);   // interrupted flush or compaction
+            } else if (!strcmp(ext, "sst") && nrun_ids < MAX_RUNS * 2) {
+                run_ids[nrun_ids++] = id;
+            }
+        } else if (sscanf(e -> d_name, "wal-%" SCNu64 ".%7s", &id, ext) == 2 &&
+                   !strcmp(ext, "log") && nwal_ids < MAX_RUNS) {
+            wal_ids[nwal_ids++] = id;
+        } else {
+            continue;
+        }
+        if (id >= kv -> next_id)
+            kv -> next_id = id + 1;
+    }
+    closedir(d);
+    qsort(run_ids, nrun_ids, sizeof(uint64_t), compare_u64);
+    qsort(wal_ids, nwal_ids, sizeof(uint64_t), compare_u64);
+
+    // newest first, so a merged run is seen before the inputs it covers
+    uint64_t covered = UINT64_MAX;
+    run *loaded[MAX_RUNS * 2];
+    int nloaded = 0;
+    for (int i = nrun_ids - 1; i >= 0; i--) {
+        kv_path(kv, path, "run", run_ids[i], ".sst");
+        if (run_ids[i] >= covered) {
+            unlink(path);
+            continue;
+        }
+        run *r = load_run(path, run_ids[i]);
+        if (!r) {
+            fprintf(stderr, "%s: corrupt run\n", path);
+            exit(1);
+        }
+        loaded[nloaded++] = r;
+        covered = r -> first_id;
+    }
+    for (int i = nloaded - 1; i >= 0 && kv -> nruns < MAX_RUNS; i--)
+        kv -> runs[kv -> nruns++] = loaded[i];
+
+    // a log whose id a run covers was flushed already
+    int replayed = 0;
+    uint64_t oldest = 0;
+    for (int i = 0; i < nwal_ids; i++) {
+        int flushed = 0;
+        for (int j = 0; j < kv -> nruns; j++)
+            flushed |= wal_ids[i] >= kv -> runs[j] -> first_id && wal_ids[i] <= kv -> runs[j] -> id;
+        kv_path(kv, path, "wal", wal_ids[i], ".log");
+        if (flushed) {
+            unlink(path);
+            continue;
+        }
+        kv -> appended += replay_wal(kv, path);
+        kv -> wal_id = wal_ids[i];
+        if (!replayed++)
+            oldest = wal_ids[i];
+    }
+    kv -> durable = kv -> appended;
+
+    if (!replayed)
+        kv -> wal_id = kv -> next_id++;
+    open_wal(kv);
+    if (replayed > 1) {
+        // a crash left several logs: fold them into one run so the
+        // older ones cannot shadow anything later
+        pthread_mutex_lock(&kv -> lock);
+        begin_flush(kv, oldest);
+        pthread_mutex_unlock(&kv -> lock);
+        finish_flush(kv);
+        for (int i = 0; i < nwal_ids; i++) {
+            kv_path(kv, path, "wal", wal_ids[i], ".log");
+            unlink(path);
+        }
+    }
+
+    pthread_create(&kv -> compactor, NULL, compact_thread, kv);
+    return kv;
+}
+
+// Stop compaction and release everything; the memtable stays in the log
+void kv_close(kv_store *kv) {
+    pthread_mutex_lock(&kv -> runs_lock);
+    kv -> stop = 1;
+    pthread_cond_broadcast(&kv -> runs_changed);
+    pthread_mutex_unlock(&kv -> runs_lock);
+    pthread_join(kv -> compactor, NULL);
+
+    close(kv -> wal_fd);
+    for (int i = 0; i < kv -> nruns; i++)
+        free_run(kv -> runs[i]);
+    destroy_skip_list(kv -> mem);
+    free(kv -> buf);
+    free(kv -> spare);
+    free(kv);
+}
+
+// Writer thread t owns the keys congruent to t mod threads, so the final
+// state of every key is known without ordering writes across threads
+typedef struct kv_writer {
+    kv_store *kv;
+    int id, threads;
+    long ops, range;
+} kv_writer;
+
+// 1 in 20 operations deletes, the rest put value key * 7 + 1
+int kv_writer_op(uint64_t *seed, kv_writer *w, int *key) {
+    uint64_t r = bench_rand(seed);
+    *key = (int) ((r >> 33) % (w -> range / w -> threads)) * w -> threads + w -> id;
+    return r % 20 != 0;
+}
+
+void *kv_writer_thread(void *arg) {
+    kv_writer *w = (kv_writer *) arg;
+    uint64_t seed = 1000 + w -> id;
+    for (long i = 0; i < w -> ops; i++) {
+        int key;
+        if (kv_writer_op(&seed, w, &key))
+            kv_put(w -> kv, key, key * 7 + 1);
+        else
+            kv_delete(w -> kv, key);
+    }
+    return NULL;
+}
+
+// Current run count (and compactions and entries they wrote so far),
+// read under runs_lock
+int kv_runs(kv_store *kv, size_t *compactions, size_t *compacted) {
+    pthread_mutex_lock(&kv -> runs_lock);
+    int n = kv -> nruns;
+    if (compactions)
+        *compactions = kv -> compactions;
+    if (compacted)
+        *compacted = kv -> compacted;
+    pthread_mutex_unlock(&kv -> runs_lock);
+    return n;
+}
+
+void remove_store(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent *e;
+    char path[PATH_MAX];
+    while ((e = readdir(d)))
+        if (e -> d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, e -> d_name);
+            unlink(path);
+        }
+    closedir(d);
+    rmdir(dir);
+}
+
+// Durable write throughput by writer count (group commit), then lookup
+// cost and read amplification, then recovery time and correctness
+int bench_kv(long n, int max_threads, const char *base) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/kvbench-XXXXXX", base);
+    if (!mkdtemp(dir))
+        die(dir);
+    long range = 2 * n;
+    size_t mem_limit = 1 << 14;
+
+    for (int threads = 1; threads <= max_threads; threads *= 4) {
+        remove_store(dir);
+        kv_store *kv = kv_open(dir, mem_limit);
+        pthread_t tid[threads];
+        kv_writer w[threads];
+        double t = now_sec();
+        for (int i = 0; i < threads; i++) {
+            w[i] = (kv_writer) {kv, i, threads, n / threads, range};
+            pthread_create(&tid[i], NULL, kv_writer_thread, &w[i]);
+        }
+        for (int i = 0; i < threads; i++)
+            pthread_join(tid[i], NULL);
+        double elapsed = now_sec() - t;
+        size_t compactions, compacted;
+        int runs = kv_runs(kv, &compactions, &compacted);
+        printf("%2d writers: %.0f durable writes/s, %.1f records per fsync, %d runs after %zu "
+               "compactions (%.2f entries rewritten per write)\n",
+               threads, threads * (n / threads) / elapsed,
+               (double) kv -> appended / (kv -> fsyncs ? kv -> fsyncs : 1), runs, compactions,
+               (double) compacted / (threads * (n / threads)));
+
+        if (threads * 4 <= max_threads) {
+            kv_close(kv);
+            continue;
+        }
+
+        // what each key should hold, replaying every writer's stream
+        char *present = (char *) calloc(range, 1);
+        for (int i = 0; i < threads; i++) {
+            uint64_t seed = 1000 + i;
+            for (long j = 0; j < w[i].ops; j++) {
+                int key;
+                int put = kv_writer_op(&seed, &w[i], &key);
+                present[key] = (char) put;
+            }
+        }
+
+        long lookups = 200000, wrong = 0;
+        uint64_t seed = 5;
+        atomic_store(&kv -> lookups, 0);
+        atomic_store(&kv -> runs_probed, 0);
+        atomic_store(&kv -> blocks_read, 0);
+        t = now_sec();
+        for (long i = 0; i < lookups; i++) {
+            int key = (int) (bench_rand(&seed) % range), value;
+            wrong += kv_get(kv, key, &value) != present[key];
+        }
+        elapsed = now_sec() - t;
+        printf("lookups: %.0f ns, %.2f runs probed and %.2f blocks read per lookup, %d runs%s\n",
+               elapsed / lookups * 1e9, (double) kv -> runs_probed / lookups,
+               (double) kv -> blocks_read / lookups, kv_runs(kv, NULL, NULL), wrong ? "  WRONG VALUES" : "");
+
+        // reopen: load the runs and replay the unflushed log
+        size_t logged = kv -> mem -> count;
+        kv_close(kv);
+        t = now_sec();
+        kv = kv_open(dir, mem_limit);
+        elapsed = now_sec() - t;
+        wrong = 0;
+        for (long key = 0; key < range; key++) {
+            int value;
+            wrong += kv_get(kv, (int) key, &value) != present[key];
+        }
+        printf("recovery: %.1f ms for %d runs and %zu logged keys, %s\n", elapsed * 1e3,
+               kv_runs(kv, NULL, NULL), logged, wrong ? "CONTENTS DIFFER" : "contents match");
+        kv_close(kv);
+        free(present);
+    }
+    remove_store(dir);
+    return 0;
+}
+
+int compare_int(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+// Sorted batches merged into a list of n keys: one insert per key against
+// insert_sorted, then rank, select and range scan costs
+int bench_indexed(long n, long batch) {
+    uint64_t seed = 42;
+    int *keys = (int *) malloc(batch * sizeof(int));
+    double elapsed[2];
+
+    for (int sorted = 0; sorted < 2; sorted++) {
+        skip_list *list = create_skip_list();
+        uint64_t fill = 7;
+        for (long i = 0; i < n; i++)
+            insert(list, (int) (bench_rand(&fill) >> 33));
+
+        // ten batches of batch keys each, every batch sorted
+        seed = 42;
+        elapsed[sorted] = 0;
+        for (int b = 0; b < 10; b++) {
+            for (long i = 0; i < batch; i++)
+                keys[i] = (int) (bench_rand(&seed) >> 33);
+            qsort(keys, batch, sizeof(int), compare_int);
+
+            double t = now_sec();
+            if (sorted)
+                insert_sorted(list, keys, batch);
+            else
+                for (long i = 0; i < batch; i++)
+                    insert(list, keys[i]);
+            elapsed[sorted] += now_sec() - t;
+        }
+        printf("%-15s: %.2f M keys/s into %ld keys\n", sorted ? "insert_sorted" : "insert each",
+               10 * batch / elapsed[sorted] / 1e6, n);
+
+        if (sorted) {
+            long queries = 1000000, sum = 0;
+            double t = now_sec();
+            for (long i = 0; i < queries; i++)
+                sum += rank_of(list, keys[bench_rand(&seed) % batch]) > 0;
+            printf("rank_of        : %.0f ns\n", (now_sec() - t) / queries * 1e9);
+
+            t = now_sec();
+            for (long i = 0; i < queries; i++)
+                sum += select_kth(list, 1 + bench_rand(&seed) % list -> count) != NULL;
+            printf("select_kth     : %.0f ns\n", (now_sec() - t) / queries * 1e9);
+
+            // 1000 scans of about 1000 keys each
+            long scanned = 0;
+            int width = (int) (1000.0 * (1U << 31) / list -> count);
+            t = now_sec();
+            for (int i = 0; i < 1000; i++) {
+                int lo = (int) (bench_rand(&seed) >> 33);
+                range_iter it;
+                range_init(&it, list, lo, lo > INT_MAX - width ? INT_MAX : lo + width);
+                for (node *p = range_next(&it); p; p = range_next(&it))
+                    scanned++;
+            }
+            printf("range scans    : %.1f ns per key (%ld keys)%s\n",
+                   (now_sec() - t) / scanned * 1e9, scanned, sum == 2 * queries ? "" : "  WRONG");
+        }
+        destroy_skip_list(list);
+    }
+    free(keys);
+    return 0;
+}
+
+// Insert and search latency from 1K keys up to max_n, by decades
+int bench(long max_n) {
+    uint64_t seed = 42;
+    for (long n = 1000; n <= max_n; n *= 10) {
+        int *keys = (int *) malloc(n * sizeof(int));
+        for (long i = 0; i < n; i++)
+            keys[i] = (int) (bench_rand(&seed) >> 33);
+
+        skip_list *list = create_skip_list();
+        double t = now_sec();
+        for (long i = 0; i < n; i++)
+            insert(list, keys[i]);
+        double insert_time = now_sec() - t;
+
+        // look up stored keys in a different random order
+        long found = 0, lookups = n < 1000000 ? 1000000 : n;
+        t = now_sec();
+        for (long i = 0; i < lookups; i++)
+            found += search(list, keys[bench_rand(&seed) % n]) != NULL;
+        double search_time = now_sec() - t;
+
+        size_t bytes = 0;
+        for (int i = 0; i < MAX_LEVEL; i++)
+            bytes += list -> nodes[i].bytes;
+        printf("%10ld keys: insert %6.0f ns, search %6.0f ns, %d levels, %.1f bytes/key%s\n",
+               n, insert_time / n * 1e9, search_time / lookups * 1e9, list -> level + 1,
+               (double) bytes / list -> count, found == lookups ? "" : "  MISSING KEYS");
+
+        destroy_skip_list(list);
+        free(keys);
+    }
+    return 0;
+}
+
+// "bench [max n]" measures insert and search latency, "bench indexed [n]
+// [batch]" sorted batch inserts and rank/select/range queries, "bench
+// concurrent [max threads] [keys]" the lock-free list under mixed
+// workloads, "bench kv [n] [max writers] [dir]" the memtable store, and
+// "stress [threads] [seconds]" checks the lock-free list for linearizability
+int main(int argc, char **argv) {
+    if (argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "kv"))
+        return bench_kv(argc > 3 ? atol(argv[3]) : 100000, argc > 4 ? atoi(argv[4]) : 16,
+                        argc > 5 ? argv[5] : "/tmp");
+    if (argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "indexed"))
+        return bench_indexed(argc > 3 ? atol(argv[3]) : 1000000, argc > 4 ? atol(argv[4]) : 100000);
+    if (argc > 1 && !strcmp(argv[1], "stress"))
+        return stress(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atof(argv[3]) : 5);
+    if (argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "concurrent"))
+        return bench_concurrent(argc > 3 ? atoi(argv[3]) : 64, argc > 4 ? atol(argv[4]) : 1000000);
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+        return bench(argc > 2 ? atol(argv[2]) : 100000000);
 
     skip_list *list = create_skip_list();
 
@@ -147,5 +1942,6 @@ int main() {
     delete(list, 19);
     display(list);
 
+    destroy_skip_list(list);
     return 0;
 }
@@ -1,33 +1,93 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include "pool.h"
+#include "bench.h"
+#include "pq.h"
 
+// A node is also the caller's handle to its item: operations move nodes
+// around the heap but never move keys between nodes, so a handle keeps
+// pointing at its item until the item leaves the heap
 typedef struct node {
 	struct node *parent;
 	struct node *child;
 	struct node *right_sibling;
 	int degree;
-	int data;
+	int data;	// key
+	int id;		// caller's item id (the payload), -1 for none
 }node;
 
+// In lazy mode the root list is an unordered list of trees: insert just
+// pushes a singleton and extract_minimum links trees of equal degree in one
+// consolidate pass, with min caching the smallest root in between. The
+// eager mode keeps the textbook degree-ordered root list at all times.
 typedef struct binomial_heap {
 	node *root;
+	node *min;			// smallest root (lazy mode only)
+	bool lazy;
+	node **handles;		// handles[id]: node holding item id, or NULL
+	int id_cap;
 }binomial_heap;
 
+#define MAX_DEGREE 64
+
+// All heap nodes come from this pool (melded heaps share nodes)
+static pool node_pool = POOL_INIT(node);
+
 void init_binomial_heap(binomial_heap *bh) {
 	bh -> root = NULL;
+	bh -> min = NULL;
+	bh -> lazy = false;
+	bh -> handles = NULL;
+	bh -> id_cap = 0;
+}
+
+void init_lazy_binomial_heap(binomial_heap *bh) {
+	init_binomial_heap(bh);
+	bh -> lazy = true;
+}
+
+// Release the id map (nodes belong to node_pool)
+void free_handles(binomial_heap *bh) {
+	free(bh -> handles);
+	bh -> handles = NULL;
+	bh -> id_cap = 0;
 }
 
-node *create_node(int data) {
-	node *new_node = (node *)malloc(sizeof(node));
+node *create_node(int data, int id) {
+	node *new_node = (node *)pool_alloc(&node_pool);
 	new_node -> parent = NULL;
 	new_node -> child = NULL;
 	new_node -> right_sibling = NULL;
 	new_node -> degree = 0;
 	new_node -> data = data;
+	new_node -> id = id;
 	return new_node;
 }
 
+// Handle of the item with this id, or NULL if it is not in the heap
+node *handle_of(binomial_heap *bh, int id) {
+	return id >= 0 && id < bh -> id_cap ? bh -> handles[id] : NULL;
+}
+
+// Point the id map at n (or clear it with n == NULL). Ids index the map
+// directly, so they should be small non-negative integers like task ids.
+void set_handle(binomial_heap *bh, int id, node *n) {
+	if(id < 0)
+		return;
+	if(id >= bh -> id_cap) {
+		int cap = bh -> id_cap ? bh -> id_cap : 64;
+		while(cap <= id)
+			cap *= 2;
+		bh -> handles = (node **)realloc(bh -> handles, cap * sizeof(node *));
+		memset(bh -> handles + bh -> id_cap, 0, (cap - bh -> id_cap) * sizeof(node *));
+		bh -> id_cap = cap;
+	}
+	bh -> handles[id] = n;
+}
+
 // Merge two binomial heaps into one (maintaining degree order)
 node *merge(node *h1, node *h2) {
 	if(!h1 || !h2)
@@ -86,66 +146,290 @@ node *merge(node *h1, node *h2) {
 	return head;
 }
 
-// Find minimum value in heap (O(log n))
+// Root with the smallest key, NULL for an empty heap (O(1) lazy, O(log n) eager)
+node *minimum_root(binomial_heap *bh) {
+	if(bh -> lazy)
+		return bh -> min;
+	node *min = bh -> root;
+	for(node *curr = bh -> root; curr; curr = curr -> right_sibling)
+		if(curr -> data < min -> data)
+			min = curr;
+	return min;
+}
+
+// Find minimum value in heap, INT_MAX if it is empty
 int find_minimum(binomial_heap *bh) {
+	node *min = minimum_root(bh);
+	return min ? min -> data : INT_MAX;
+}
+
+// Link every pair of roots of equal degree until all degrees differ, then
+// rebuild the root list in degree order and recompute min. Each link
+// removes a root, so this is O(roots + log n), paid for by the inserts
+// that created the roots.
+void consolidate(binomial_heap *bh) {
+	node *by_degree[MAX_DEGREE] = {NULL};
+	int top = -1;
 	node *curr = bh -> root;
-	int min = curr -> data;
 	while(curr) {
-		if(curr -> data < min)
-			min = curr -> data;
-		curr = curr -> right_sibling;
+		node *next = curr -> right_sibling;
+		int d = curr -> degree;
+		while(by_degree[d]) {
+			node *other = by_degree[d];
+			by_degree[d] = NULL;
+			if(other -> data < curr -> data) {
+				node *t = curr;
+				curr = other;
+				other = t;
+			}
+			other -> parent = curr;
+			other -> right_sibling = curr -> child;
+			curr -> child = other;
+			curr -> degree = ++d;
+		}
+		by_degree[d] = curr;
+		if(d > top)
+			top = d;
+		curr = next;
 	}
-	return min;
+
+	node **tail = &bh -> root;
+	bh -> min = NULL;
+	for(int d = 0; d <= top; d++) {
+		if(!by_degree[d])
+			continue;
+		*tail = by_degree[d];
+		tail = &by_degree[d] -> right_sibling;
+		if(!bh -> min || by_degree[d] -> data < bh -> min -> data)
+			bh -> min = by_degree[d];
+	}
+	*tail = NULL;
+}
+
+// Push a tree onto the lazy root list (O(1))
+void push_root(binomial_heap *bh, node *n) {
+	n -> right_sibling = bh -> root;
+	bh -> root = n;
+	if(!bh -> min || n -> data < bh -> min -> data)
+		bh -> min = n;
 }
 
 // Reverse child list for merging after extraction
 node *reverse_ll(node *head) {
-	if(!head || !head -> right_sibling)
-		return head;
-	node *new_head = reverse_ll(head -> right_sibling);
-	head -> right_sibling -> right_sibling = head;
-	head -> right_sibling = NULL;
-	head -> parent = NULL;
-	return new_head;
+	node *prev = NULL;
+	while(head) {
+		node *next = head -> right_sibling;
+		head -> right_sibling = prev;
+		head -> parent = NULL;
+		prev = head;
+		head = next;
+	}
+	return prev;
 }
 
-// Extract and return minimum value (O(log n))
-int extract_minimum(binomial_heap *bh) {
-	node *curr = bh -> root;
-	node *prev = NULL, *prev_min = NULL;
-	node *min_node = bh -> root;
-	
-	while(curr) {
-		if(curr -> data < min_node -> data) {
-			min_node = curr;
-			prev_min = prev;
-		}
-		prev = curr;
-		curr = curr -> right_sibling;
+// The link that points at n: its parent's child field, its left
+// sibling's right_sibling field, or the root list head (O(log n))
+node **link_to(binomial_heap *bh, node *n) {
+	node **link = n -> parent ? &n -> parent -> child : &bh -> root;
+	while(*link != n)
+		link = &(*link) -> right_sibling;
+	return link;
+}
+
+// Detach root r from the root list and merge its children back in;
+// r keeps its key and id but is no longer in the heap
+void remove_root(binomial_heap *bh, node *r) {
+	*link_to(bh, r) = r -> right_sibling;
+	if(!bh -> lazy) {
+		bh -> root = merge(bh -> root, reverse_ll(r -> child));
+		return;
 	}
-	if(prev_min)
-		prev_min -> right_sibling = min_node -> right_sibling;
-	else
-		bh -> root = min_node -> right_sibling;
-	
-	node *new_heap = reverse_ll(min_node -> child);
-	bh -> root = merge(bh -> root, new_heap);
+	node *c = r -> child;
+	while(c) {
+		node *next = c -> right_sibling;
+		c -> parent = NULL;
+		c -> right_sibling = bh -> root;
+		bh -> root = c;
+		c = next;
+	}
+	consolidate(bh);
+}
+
+// Extract and return minimum value (O(log n), amortised in lazy mode);
+// *id gets its item's id. An empty heap gives INT_MAX and id -1.
+int extract_minimum_id(binomial_heap *bh, int *id) {
+	node *min_node = minimum_root(bh);
+	if(!min_node) {
+		*id = -1;
+		return INT_MAX;
+	}
+
+	remove_root(bh, min_node);
 	int min_val = min_node -> data;
-	free(min_node);
+	*id = min_node -> id;
+	if(handle_of(bh, min_node -> id) == min_node)
+		set_handle(bh, min_node -> id, NULL);
+	pool_free(&node_pool, min_node);
 	return min_val;
 }
 
-// Insert new key (just merge a singleton tree)
+int extract_minimum(binomial_heap *bh) {
+	int id;
+	return extract_minimum_id(bh, &id);
+}
+
+// Sift helpers for the frontier of extract_k_minimum (a binary min-heap
+// of node pointers ordered by key)
+static void frontier_push(node ***f, int *len, int *cap, node *n) {
+	if(*len == *cap) {
+		*cap = *cap ? *cap * 2 : 64;
+		*f = (node **)realloc(*f, *cap * sizeof(node *));
+	}
+	int i = (*len)++;
+	while(i > 0 && (*f)[(i - 1) / 2] -> data > n -> data) {
+		(*f)[i] = (*f)[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	(*f)[i] = n;
+}
+
+static node *frontier_pop(node **f, int *len) {
+	node *top = f[0], *last = f[--*len];
+	int i = 0;
+	for(;;) {
+		int c = 2 * i + 1;
+		if(c >= *len)
+			break;
+		if(c + 1 < *len && f[c + 1] -> data < f[c] -> data)
+			c++;
+		if(f[c] -> data >= last -> data)
+			break;
+		f[i] = f[c];
+		i = c;
+	}
+	if(*len)
+		f[i] = last;
+	return top;
+}
+
+// Remove the k smallest keys into out[] in sorted order; returns how many
+// were removed (fewer than k if the heap runs out). The k smallest nodes
+// form a subtree closed under parents, so they are found by a best-first
+// walk from the roots that only ever looks at children of removed nodes.
+// Whatever is left in the frontier is exactly the new root list, which
+// is restructured with one consolidate pass instead of k extractions.
+int extract_k_minimum(binomial_heap *bh, int k, int out[]) {
+	node **f = NULL;
+	int len = 0, cap = 0, taken = 0;
+	for(node *r = bh -> root; r; r = r -> right_sibling)
+		frontier_push(&f, &len, &cap, r);
+
+	while(taken < k && len) {
+		node *n = frontier_pop(f, &len);
+		for(node *c = n -> child; c; c = c -> right_sibling)
+			frontier_push(&f, &len, &cap, c);
+		out[taken++] = n -> data;
+		if(handle_of(bh, n -> id) == n)
+			set_handle(bh, n -> id, NULL);
+		pool_free(&node_pool, n);
+	}
+
+	bh -> root = NULL;
+	for(int i = 0; i < len; i++) {
+		f[i] -> parent = NULL;
+		f[i] -> right_sibling = bh -> root;
+		bh -> root = f[i];
+	}
+	consolidate(bh);
+	free(f);
+	return taken;
+}
+
+// Add a singleton tree: eager mode merges it, lazy mode just pushes it
+void add_node(binomial_heap *bh, node *n) {
+	if(bh -> lazy)
+		push_root(bh, n);
+	else
+		bh -> root = merge(bh -> root, n);
+}
+
+// Insert an item and return its handle; ids >= 0 go in the id map
+node *insert_item(binomial_heap *bh, int data, int id) {
+	node *n = create_node(data, id);
+	set_handle(bh, id, n);
+	add_node(bh, n);
+	return n;
+}
+
+// Move every item of other into bh (both in the same mode), leaving
+// other empty; ids in other's map must not be in use in bh's
+void unite(binomial_heap *bh, binomial_heap *other) {
+	if(bh -> lazy) {
+		node **tail = &bh -> root;
+		while(*tail)
+			tail = &(*tail) -> right_sibling;
+		*tail = other -> root;
+		if(other -> min && (!bh -> min || other -> min -> data < bh -> min -> data))
+			bh -> min = other -> min;
+	} else
+		bh -> root = merge(bh -> root, other -> root);
+
+	for(int id = 0; id < other -> id_cap; id++)
+		if(other -> handles[id])
+			set_handle(bh, id, other -> handles[id]);
+	free_handles(other);
+	other -> root = other -> min = NULL;
+}
+
+// Insert new key
 void insert(binomial_heap *bh, int data) {
-	bh -> root = merge(bh -> root, create_node(data));
+	insert_item(bh, data, -1);
 }
 
-// Swap data of two nodes
-node *swap(node *a, node *b) {
-	int temp = a -> data;
-	a -> data = b -> data;
-	b -> data = temp;
-	return b;
+// Add n keys at once (ids may be NULL): push them all as singletons and
+// consolidate once, which links them in O(n) total instead of n merges.
+// The result is degree-ordered, so this works in either mode.
+void build_heap(binomial_heap *bh, const int *keys, const int *ids, int n) {
+	for(int i = 0; i < n; i++) {
+		node *x = create_node(keys[i], ids ? ids[i] : -1);
+		set_handle(bh, x -> id, x);
+		x -> right_sibling = bh -> root;
+		bh -> root = x;
+	}
+	consolidate(bh);
+}
+
+// Exchange h with its parent p in the tree. The nodes themselves move
+// (h takes p's place and p takes h's), so handles stay valid; it costs
+// O(log n) for the sibling lookups and parent pointer updates.
+void swap_with_parent(binomial_heap *bh, node *h) {
+	node *p = h -> parent;
+	node **p_link = link_to(bh, p);
+	node **h_link = link_to(bh, h);
+	node *h_right = h -> right_sibling, *h_child = h -> child;
+	int h_degree = h -> degree;
+
+	// h takes p's place, and p's children, with p where h was
+	*p_link = h;
+	h -> parent = p -> parent;
+	h -> right_sibling = p -> right_sibling;
+	h -> degree = p -> degree;
+	if(h_link == &p -> child) {
+		h -> child = p;
+	} else {
+		*h_link = p;
+		h -> child = p -> child;
+	}
+
+	// p takes h's old siblings and children
+	p -> right_sibling = h_right;
+	p -> child = h_child;
+	p -> degree = h_degree;
+
+	for(node *c = h -> child; c; c = c -> right_sibling)
+		c -> parent = h;
+	for(node *c = h_child; c; c = c -> right_sibling)
+		c -> parent = p;
 }
 
 // Decrease key of a node and maintain heap property
@@ -154,7 +438,50 @@ void decrease_key(binomial_heap *bh, node *h, int key) {
 		return;
 	h -> data = key;
 	while(h -> parent && h -> data < h -> parent -> data)
-		h = swap(h, h -> parent);
+		swap_with_parent(bh, h);
+	if(bh -> lazy && !h -> parent && h -> data < bh -> min -> data)
+		bh -> min = h;
+}
+
+// Remove an item by handle: float it to its root as if its key were
+// minus infinity, then remove that root
+void delete_node(binomial_heap *bh, node *h) {
+	while(h -> parent)
+		swap_with_parent(bh, h);
+	remove_root(bh, h);
+	if(handle_of(bh, h -> id) == h)
+		set_handle(bh, h -> id, NULL);
+	pool_free(&node_pool, h);
+}
+
+// Increase key of a node and sift it down below its smallest child while
+// that child is smaller. Most nodes sit near the leaves, so this is
+// usually much cheaper than taking the node out and merging it back.
+void increase_key(binomial_heap *bh, node *h, int key) {
+	if(!h || key <= h -> data)
+		return;
+	h -> data = key;
+	for(;;) {
+		node *min_child = h -> child;
+		for(node *c = h -> child; c; c = c -> right_sibling)
+			if(c -> data < min_child -> data)
+				min_child = c;
+		if(!min_child || min_child -> data >= h -> data)
+			break;
+		swap_with_parent(bh, min_child);
+	}
+	// the cached minimum may have grown past another root
+	if(bh -> lazy && bh -> min == h)
+		consolidate(bh);
+}
+
+// Set an item's key by id, in either direction
+void update_key(binomial_heap *bh, int id, int key) {
+	node *h = handle_of(bh, id);
+	if(h && key < h -> data)
+		decrease_key(bh, h, key);
+	else if(h)
+		increase_key(bh, h, key);
 }
 
 // Recursive print (for debugging)
@@ -166,7 +493,309 @@ void print_heap(node *h) {
 	print_heap(h -> right_sibling);
 }
 
-int main(void) {
+// Check heap order, parent links, degrees and the id map below n;
+// returns the number of nodes, or -1
+long check_tree(binomial_heap *bh, node *n, node *parent) {
+	long count = 0;
+	for(; n; n = n -> right_sibling) {
+		int children = 0;
+		for(node *c = n -> child; c; c = c -> right_sibling)
+			children++;
+		if(n -> parent != parent || (parent && n -> data < parent -> data) ||
+		   children != n -> degree || (bh -> handles && n -> id >= 0 && handle_of(bh, n -> id) != n))
+			return -1;
+		long below = check_tree(bh, n -> child, n);
+		if(below < 0)
+			return -1;
+		count += below + 1;
+	}
+	return count;
+}
+
+// Scheduler workload over n tasks: 70% reprioritize a random task, 20%
+// run the most urgent task and reschedule it, 10% cancel a task and
+// submit a new one under its id. With handles every change is applied
+// in place; the baseline heap has no handles, so it inserts a fresh
+// entry per change and skips an entry when it reaches the top with a key
+// that is no longer its task's priority.
+int bench(int n, long ops) {
+	int *prio = (int *)malloc(n * sizeof(int));
+	const char *names[] = {"handles", "stale reinsert"};
+
+	for(int stale_reinsert = 0; stale_reinsert < 2; stale_reinsert++) {
+		binomial_heap bh;
+		init_binomial_heap(&bh);
+		uint64_t seed = 42;
+		long now = 0, ran = 0, stale = 0;
+		size_t peak = 0;
+
+		for(int i = 0; i < n; i++) {
+			prio[i] = (int)(bench_rand(&seed) % 1000000);
+			if(stale_reinsert)
+				bh.root = merge(bh.root, create_node(prio[i], i));
+			else
+				insert_item(&bh, prio[i], i);
+		}
+
+		double t = now_sec();
+		for(long op = 0; op < ops; op++) {
+			uint64_t r = bench_rand(&seed);
+			int id = (int)((r >> 32) % n);
+			int kind = (int)(r % 100);
+			int key = (int)(now + (r >> 8) % 1000000);
+
+			if(kind < 70) {
+				prio[id] = key;
+				if(stale_reinsert)
+					bh.root = merge(bh.root, create_node(key, id));
+				else
+					update_key(&bh, id, key);
+			} else if(kind < 90) {
+				int min, min_id;
+				do {
+					min = extract_minimum_id(&bh, &min_id);
+				} while(stale_reinsert && min != prio[min_id] && ++stale);
+				now = min;
+				ran++;
+				prio[min_id] = (int)(now + (r >> 8) % 1000000);
+				if(stale_reinsert)
+					bh.root = merge(bh.root, create_node(prio[min_id], min_id));
+				else
+					insert_item(&bh, prio[min_id], min_id);
+			} else {
+				prio[id] = key;
+				if(stale_reinsert) {
+					// the old entry goes stale; the new one has the new key
+					bh.root = merge(bh.root, create_node(key, id));
+				} else {
+					delete_node(&bh, handle_of(&bh, id));
+					insert_item(&bh, key, id);
+				}
+			}
+			if(node_pool.live > peak)
+				peak = node_pool.live;
+		}
+		double elapsed = now_sec() - t;
+
+		long nodes = check_tree(&bh, bh.root, NULL);
+		printf("%-14s: %.2f M ops/s, %ld tasks run, peak %zu nodes, %ld stale entries skipped%s\n",
+		       names[stale_reinsert], ops / elapsed / 1e6, ran, peak, stale,
+		       nodes < 0 || (!stale_reinsert && nodes != n) ? "  BROKEN HEAP" : "");
+		free_handles(&bh);
+		pool_destroy(&node_pool);
+	}
+	free(prio);
+	return 0;
+}
+
+// Run ops operations on bh: pct% inserts of random keys, the rest
+// extract_minimum, each preceded by a find_minimum peek. Returns the sum
+// of extracted keys so the two modes can be checked against each other.
+long run_mix(binomial_heap *bh, long ops, int pct, uint64_t *seed) {
+	long sum = 0;
+	for(long op = 0; op < ops; op++) {
+		uint64_t r = bench_rand(seed);
+		if((int)(r % 100) < pct || !bh -> root) {
+			insert(bh, (int)((r >> 32) % 1000000000));
+		} else {
+			int min = find_minimum(bh);
+			if(extract_minimum(bh) != min)
+				sum = LONG_MIN;
+			sum += min;
+		}
+	}
+	return sum;
+}
+
+// Eager vs lazy binomial heap: n inserts, n-key bulk build, an
+// insert-heavy (90% insert) and a mixed (50%) workload of ops
+// operations, then draining the heap
+int bench_lazy(int n, long ops) {
+	const char *names[] = {"eager", "lazy"};
+	int *keys = (int *)malloc(n * sizeof(int));
+	uint64_t seed = 7;
+	for(int i = 0; i < n; i++)
+		keys[i] = (int)(bench_rand(&seed) % 1000000000);
+
+	printf("%d keys, %ld operations per workload (M ops/s)\n", n, ops);
+	printf("%-6s %9s %9s %9s %9s %9s\n", "mode", "insert", "build", "ins-heavy", "mixed", "drain");
+	long sums[2];
+	for(int lazy = 0; lazy < 2; lazy++) {
+		binomial_heap bh;
+		double rate[5];
+
+		init_binomial_heap(&bh);
+		bh.lazy = lazy;
+		double t = now_sec();
+		for(int i = 0; i < n; i++)
+			insert(&bh, keys[i]);
+		rate[0] = n / (now_sec() - t) / 1e6;
+		pool_destroy(&node_pool);
+
+		init_binomial_heap(&bh);
+		bh.lazy = lazy;
+		t = now_sec();
+		build_heap(&bh, keys, NULL, n);
+		rate[1] = n / (now_sec() - t) / 1e6;
+
+		seed = 99;
+		t = now_sec();
+		long sum = run_mix(&bh, ops, 90, &seed);
+		rate[2] = ops / (now_sec() - t) / 1e6;
+		t = now_sec();
+		sum += run_mix(&bh, ops, 50, &seed);
+		rate[3] = ops / (now_sec() - t) / 1e6;
+
+		long nodes = check_tree(&bh, bh.root, NULL);
+		t = now_sec();
+		int prev = INT_MIN;
+		bool sorted = true;
+		for(long i = 0; i < nodes; i++) {
+			int k = extract_minimum(&bh);
+			sorted = sorted && k >= prev;
+			prev = k;
+			sum += k;
+		}
+		rate[4] = nodes / (now_sec() - t) / 1e6;
+		sums[lazy] = sum;
+
+		printf("%-6s %9.2f %9.2f %9.2f %9.2f %9.2f%s\n", names[lazy],
+		       rate[0], rate[1], rate[2], rate[3], rate[4],
+		       nodes < 0 || !sorted || bh.root ? "  BROKEN HEAP" : "");
+		pool_destroy(&node_pool);
+	}
+	if(sums[0] != sums[1])
+		printf("eager and lazy heaps extracted different keys\n");
+	free(keys);
+	return 0;
+}
+
+// The binomial heap, eager and lazy, as pq.h engines. The handle is the
+// node; the id map is left empty since the pq.h caller keeps the handles.
+static void *pq_binomial_create(void) {
+	binomial_heap *bh = (binomial_heap *)malloc(sizeof(binomial_heap));
+	init_binomial_heap(bh);
+	return bh;
+}
+
+static void *pq_binomial_lazy_create(void) {
+	binomial_heap *bh = (binomial_heap *)pq_binomial_create();
+	bh -> lazy = true;
+	return bh;
+}
+
+static void pq_binomial_destroy(void *q) {
+	free_handles((binomial_heap *)q);
+	free(q);
+}
+
+static pq_handle pq_binomial_insert(void *q, int key, int id) {
+	node *n = create_node(key, id);
+	add_node((binomial_heap *)q, n);
+	return n;
+}
+
+static int pq_binomial_find_min(void *q) {
+	return find_minimum((binomial_heap *)q);
+}
+
+static int pq_binomial_extract_min(void *q, int *id) {
+	return extract_minimum_id((binomial_heap *)q, id);
+}
+
+static void pq_binomial_decrease_key(void *q, pq_handle h, int key) {
+	decrease_key((binomial_heap *)q, (node *)h, key);
+}
+
+static void pq_binomial_meld(void *q, void *other) {
+	unite((binomial_heap *)q, (binomial_heap *)other);
+}
+
+static void pq_binomial_release(void) {
+	pool_destroy(&node_pool);
+}
+
+static size_t pq_binomial_bytes(void) {
+	return node_pool.bytes;
+}
+
+static const pq_engine binomial_engine = {
+	"binomial", pq_binomial_create, pq_binomial_destroy, pq_binomial_insert,
+	pq_binomial_find_min, pq_binomial_extract_min, pq_binomial_decrease_key,
+	pq_binomial_meld, pq_binomial_release, pq_binomial_bytes
+};
+
+static const pq_engine lazy_binomial_engine = {
+	"binomial lazy", pq_binomial_lazy_create, pq_binomial_destroy, pq_binomial_insert,
+	pq_binomial_find_min, pq_binomial_extract_min, pq_binomial_decrease_key,
+	pq_binomial_meld, pq_binomial_release, pq_binomial_bytes
+};
+
+// Batch draining: keep n keys in the heap and repeatedly refill k random
+// keys and take the k smallest out, either with extract_k_minimum or with
+// k extract_minimum calls; reports ns per extracted key
+int bench_batch(int n, long total) {
+	printf("%d keys, %ld extracted per run (ns/key)\n", n, total);
+	printf("%6s %10s %10s %10s %10s\n", "k", "eager loop", "eager k", "lazy loop", "lazy k");
+	int *out = (int *)malloc(4096 * sizeof(int));
+	for(int k = 16; k <= 4096; k *= 4) {
+		double ns[4];
+		uint64_t sums[4];
+		bool ok = true;
+		for(int run = 0; run < 4; run++) {
+			binomial_heap bh;
+			init_binomial_heap(&bh);
+			bh.lazy = run >= 2;
+			uint64_t seed = 5;
+			for(int i = 0; i < n; i++)
+				insert(&bh, (int)(bench_rand(&seed) % 1000000000));
+
+			double spent = 0;
+			uint64_t sum = 0;
+			for(long done = 0; done < total; done += k) {
+				for(int i = 0; i < k; i++)
+					insert(&bh, (int)(bench_rand(&seed) % 1000000000));
+				double t = now_sec();
+				if(run % 2) {
+					extract_k_minimum(&bh, k, out);
+				} else {
+					for(int i = 0; i < k; i++)
+						out[i] = extract_minimum(&bh);
+				}
+				spent += now_sec() - t;
+				for(int i = 0; i < k; i++)
+					sum = sum * 31 + (uint64_t)out[i];
+			}
+			ns[run] = spent / total * 1e9;
+			sums[run] = sum;
+			ok = ok && check_tree(&bh, bh.root, NULL) == n && sum == sums[0];
+			pool_destroy(&node_pool);
+		}
+		printf("%6d %10.1f %10.1f %10.1f %10.1f%s\n", k, ns[0], ns[1], ns[2], ns[3],
+		       ok ? "" : "  MISMATCH");
+	}
+	free(out);
+	return 0;
+}
+
+// "bench [tasks] [operations]" runs the scheduler workload,
+// "bench lazy [keys] [operations]" compares the eager and lazy modes,
+// "bench batch [keys] [extracted]" times extract_k_minimum for k = 16..4096,
+// "bench pq [ids]" runs the pq.h traces through the binomial heap and the
+// pq.h engines
+int main(int argc, char **argv) {
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "pq")) {
+		const pq_engine *engines[] = {&binomial_engine, &lazy_binomial_engine,
+		                              &pq_pairing_engine, &pq_dary_engine, &pq_radix_engine};
+		return pq_bench(engines, 5, argc > 3 ? atoi(argv[3]) : 1000000);
+	}
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "batch"))
+		return bench_batch(argc > 3 ? atoi(argv[3]) : 1000000, argc > 4 ? atol(argv[4]) : 1000000);
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "lazy"))
+		return bench_lazy(argc > 3 ? atoi(argv[3]) : 1000000, argc > 4 ? atol(argv[4]) : 4000000);
+	if(argc > 1 && !strcmp(argv[1], "bench"))
+		return bench(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atol(argv[3]) : 10000000);
+
 	binomial_heap h1, h2;
 	init_binomial_heap(&h1);
 	init_binomial_heap(&h2);
@@ -185,6 +814,7 @@ int main(void) {
 
 	// Unite two heaps
 	binomial_heap united;
+	init_binomial_heap(&united);
 	united.root = merge(h1.root, h2.root);
 	printf("After unite, min: %d\n", find_minimum(&united));
 
@@ -198,6 +828,7 @@ int main(void) {
 	decrease_key(&united, p, 1);
 	printf("Min after decrease: %d\n", find_minimum(&united));
 
+	pool_destroy(&node_pool);
 	return 0;
 }
 
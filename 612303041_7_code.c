@@ -2,6 +2,13 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "pool.h"
+#include "bench.h"
+#include "pq.h"
 
 #define MAX_DEG 50   // Max degree of a node in heap
 
@@ -14,6 +21,7 @@ typedef struct node {
 	int degree;
 	bool mark;
 	int data;
+	int id;		// caller's item id, -1 for none
 } node;
 
 // Fibonacci Heap structure
@@ -22,9 +30,12 @@ typedef struct fheap {
 	int nodes;     // Total number of nodes
 } fheap;
 
-// Create a new node with given key
-node *create_node(int data) {
-	node *n = (node *)malloc(sizeof(node));
+// All heap nodes come from this pool (melded heaps share nodes)
+static pool node_pool = POOL_INIT(node);
+
+// Create a new node with given key and item id
+node *create_node(int data, int id) {
+	node *n = (node *)pool_alloc(&node_pool);
 	n -> parent = NULL;
 	n -> child = NULL;
 	n -> left = n;
@@ -32,6 +43,7 @@ node *create_node(int data) {
 	n -> degree = 0;
 	n -> mark = false;
 	n -> data = data;
+	n -> id = id;
 	return n;
 }
 
@@ -65,9 +77,9 @@ fheap *merge(fheap *h1, fheap *h2) {
 	return h1;
 }
 
-// Insert a new key into the heap
-void insert(fheap *fh, int data) {
-	node *n = create_node(data);
+// Insert an item into the heap; the node is its handle for decrease_key
+node *insert_item(fheap *fh, int data, int id) {
+	node *n = create_node(data, id);
 
 	if(!fh -> minode)
 		fh -> minode = n;
@@ -83,6 +95,12 @@ void insert(fheap *fh, int data) {
 			fh -> minode = n;
 	}
 	fh -> nodes++;
+	return n;
+}
+
+// Insert a new key into the heap
+void insert(fheap *fh, int data) {
+	insert_item(fh, data, -1);
 }
 
 // Return the minimum key from the heap
@@ -93,11 +111,20 @@ int find_min(fheap *fh) {
 // Combine trees of same degree to maintain Fibonacci Heap properties
 void consolidate(fheap *fh) {
 	node *arr[MAX_DEG] = {NULL};
-	node *start = fh -> minode;
-	node *p = start;
+	node *p = fh -> minode;
 
+	// Count the roots first and step to the next root before linking:
+	// once the current root goes under another one, its right pointer
+	// leads into a child list
+	int roots = 0;
 	do {
+		roots++;
+		p = p -> right;
+	} while(p != fh -> minode);
+
+	while(roots--) {
 		node *x = p;
+		p = p -> right;
 		int d = x -> degree;
 
 		// Merge trees of equal degree
@@ -131,8 +158,7 @@ void consolidate(fheap *fh) {
 		}
 
 		arr[d] = x;
-		p = p -> right;
-	} while(p != start);
+	}
 
 	// Rebuild root list and find new min
 	fh -> minode = NULL;
@@ -155,8 +181,8 @@ void consolidate(fheap *fh) {
 	}
 }
 
-// Remove and return the minimum key from the heap
-int extract_minimum(fheap *fh) {
+// Remove and return the minimum key from the heap; *id gets its item id
+int extract_minimum_id(fheap *fh, int *id) {
 	if(!fh || !fh -> minode)
 		return INT_MIN;
 
@@ -170,12 +196,13 @@ int extract_minimum(fheap *fh) {
 			c = c -> right;
 		} while(c != z -> child);
 
-		node *zl = z -> left;
+		// splice them in right after z, which is unlinked below
 		node *cl = z -> child -> left;
-		zl -> right = z -> child;
-		z -> child -> left = zl;
-		cl -> right = z -> right;
-		z -> right -> left = cl;
+		node *zr = z -> right;
+		z -> right = z -> child;
+		z -> child -> left = z;
+		cl -> right = zr;
+		zr -> left = cl;
 	}
 
 	// Remove z from root list
@@ -183,6 +210,7 @@ int extract_minimum(fheap *fh) {
 	z -> right -> left = z -> left;
 
 	int min_val = z -> data;
+	*id = z -> id;
 
 	// If last node, heap becomes empty
 	if(z == z -> right)
@@ -192,11 +220,16 @@ int extract_minimum(fheap *fh) {
 		consolidate(fh);
 	}
 
-	free(z);
+	pool_free(&node_pool, z);
 	fh -> nodes--;
 	return min_val;
 }
 
+int extract_minimum(fheap *fh) {
+	int id;
+	return extract_minimum_id(fh, &id);
+}
+
 // Cut node p from its parent q and move to root list
 void cut(fheap *fh, node *p, node *q) {
 	if(p -> right == p)
@@ -251,7 +284,1026 @@ void decrease_key(fheap *fh, node *p, int key) {
 		fh -> minode = p;
 }
 
-int main() {
+// The Fibonacci heap as a pq.h engine; the handle is the node
+static void *pq_fib_create(void) {
+	fheap *fh = (fheap *)malloc(sizeof(fheap));
+	init_heap(fh);
+	return fh;
+}
+
+static void pq_fib_destroy(void *q) {
+	free(q);
+}
+
+static pq_handle pq_fib_insert(void *q, int key, int id) {
+	return insert_item((fheap *)q, key, id);
+}
+
+static int pq_fib_find_min(void *q) {
+	return find_min((fheap *)q);
+}
+
+static int pq_fib_extract_min(void *q, int *id) {
+	return extract_minimum_id((fheap *)q, id);
+}
+
+static void pq_fib_decrease_key(void *q, pq_handle h, int key) {
+	decrease_key((fheap *)q, (node *)h, key);
+}
+
+// merge() returns whichever heap holds the result; make that q
+static void pq_fib_meld(void *q, void *other) {
+	fheap *m = merge((fheap *)q, (fheap *)other);
+	if(m != q)
+		*(fheap *)q = *m;
+	init_heap((fheap *)other);
+}
+
+static void pq_fib_release(void) {
+	pool_destroy(&node_pool);
+}
+
+static size_t pq_fib_bytes(void) {
+	return node_pool.bytes;
+}
+
+static const pq_engine fib_engine = {
+	"fibonacci", pq_fib_create, pq_fib_destroy, pq_fib_insert,
+	pq_fib_find_min, pq_fib_extract_min, pq_fib_decrease_key,
+	pq_fib_meld, pq_fib_release, pq_fib_bytes
+};
+
+// ---- Compact index-based Fibonacci heap ----
+// Nodes live in one growable array and link to each other by 32-bit
+// index, with degree and mark packed into one byte: 24 bytes per node
+// instead of 48, and the index doubles as the item's handle. Freed slots
+// are reused through a free list threaded through right.
+
+#define CNIL UINT32_MAX
+#define CMARK 0x80		// mark bit in degmark; the low 7 bits are the degree
+
+typedef struct cnode {
+	uint32_t parent;
+	uint32_t child;
+	uint32_t left;
+	uint32_t right;
+	int key;
+	uint8_t degmark;
+} cnode;
+
+typedef struct compact_heap {
+	cnode *nodes;
+	uint32_t cap;
+	uint32_t used;		// slots handed out so far
+	uint32_t free;		// first free slot, CNIL if none
+	uint32_t size;		// items in the heap
+	uint32_t min;
+} compact_heap;
+
+void compact_init(compact_heap *h, uint32_t capacity) {
+	h -> cap = capacity ? capacity : 64;
+	h -> nodes = (cnode *)malloc((size_t)h -> cap * sizeof(cnode));
+	h -> used = h -> size = 0;
+	h -> free = h -> min = CNIL;
+}
+
+void compact_destroy(compact_heap *h) {
+	free(h -> nodes);
+}
+
+// Put x into the circular list right after a
+static inline void compact_splice(cnode *n, uint32_t a, uint32_t x) {
+	n[x].left = a;
+	n[x].right = n[a].right;
+	n[n[a].right].left = x;
+	n[a].right = x;
+}
+
+static inline void compact_unlink(cnode *n, uint32_t x) {
+	n[n[x].left].right = n[x].right;
+	n[n[x].right].left = n[x].left;
+}
+
+// Insert a key; the returned index is the item's handle
+uint32_t compact_insert(compact_heap *h, int key) {
+	uint32_t x = h -> free;
+	if(x != CNIL)
+		h -> free = h -> nodes[x].right;
+	else {
+		if(h -> used == h -> cap) {
+			h -> cap *= 2;
+			h -> nodes = (cnode *)realloc(h -> nodes, (size_t)h -> cap * sizeof(cnode));
+		}
+		x = h -> used++;
+	}
+
+	cnode *n = h -> nodes;
+	n[x] = (cnode) {CNIL, CNIL, x, x, key, 0};
+	if(h -> min == CNIL)
+		h -> min = x;
+	else {
+		compact_splice(n, h -> min, x);
+		if(key < n[h -> min].key)
+			h -> min = x;
+	}
+	h -> size++;
+	return x;
+}
+
+// Link roots of equal degree. The degree of any node in a Fibonacci heap
+// of size items is at most log_phi(size), so the table only needs that
+// many entries (the smallest d with Fib(d + 2) > size).
+void compact_consolidate(compact_heap *h) {
+	cnode *n = h -> nodes;
+	int bound = 1;
+	for(uint64_t a = 1, b = 2; b <= h -> size; bound++) {
+		uint64_t t = a + b;
+		a = b;
+		b = t;
+	}
+	uint32_t table[bound + 1];
+	for(int d = 0; d <= bound; d++)
+		table[d] = CNIL;
+
+	uint32_t p = h -> min, roots = 0;
+	do {
+		roots++;
+		p = n[p].right;
+	} while(p != h -> min);
+
+	while(roots--) {
+		uint32_t x = p;
+		p = n[p].right;
+		int d = n[x].degmark & ~CMARK;
+		while(table[d] != CNIL) {
+			uint32_t y = table[d];
+			if(n[y].key < n[x].key) {
+				uint32_t t = x;
+				x = y;
+				y = t;
+			}
+			compact_unlink(n, y);
+			n[y].parent = x;
+			n[y].degmark = (uint8_t)d;	// clears y's mark
+			if(n[x].child == CNIL) {
+				n[x].child = y;
+				n[y].left = n[y].right = y;
+			} else
+				compact_splice(n, n[x].child, y);
+			n[x].degmark++;
+			table[d++] = CNIL;
+		}
+		table[d] = x;
+	}
+
+	h -> min = CNIL;
+	for(int d = 0; d <= bound; d++)
+		if(table[d] != CNIL && (h -> min == CNIL || n[table[d]].key < n[h -> min].key))
+			h -> min = table[d];
+}
+
+// Remove the minimum; *x gets its index (now free for reuse)
+int compact_extract_min(compact_heap *h, uint32_t *x) {
+	cnode *n = h -> nodes;
+	uint32_t z = h -> min;
+	if(n[z].child != CNIL) {
+		uint32_t c = n[z].child;
+		do {
+			n[c].parent = CNIL;
+			c = n[c].right;
+		} while(c != n[z].child);
+
+		uint32_t cl = n[c].left, zr = n[z].right;
+		n[z].right = c;
+		n[c].left = z;
+		n[cl].right = zr;
+		n[zr].left = cl;
+	}
+	compact_unlink(n, z);
+
+	h -> size--;
+	if(n[z].right == z)
+		h -> min = CNIL;
+	else {
+		h -> min = n[z].right;
+		compact_consolidate(h);
+	}
+
+	n[z].right = h -> free;
+	h -> free = z;
+	*x = z;
+	return n[z].key;
+}
+
+// Move x from its parent p's child list to the root list
+static inline void compact_cut(compact_heap *h, uint32_t x, uint32_t p) {
+	cnode *n = h -> nodes;
+	if(n[x].right == x)
+		n[p].child = CNIL;
+	else {
+		compact_unlink(n, x);
+		if(n[p].child == x)
+			n[p].child = n[x].right;
+	}
+	n[p].degmark--;
+	compact_splice(n, h -> min, x);
+	n[x].parent = CNIL;
+	n[x].degmark &= ~CMARK;
+}
+
+void compact_decrease_key(compact_heap *h, uint32_t x, int key) {
+	cnode *n = h -> nodes;
+	if(key > n[x].key)
+		return;
+	n[x].key = key;
+	uint32_t p = n[x].parent;
+	if(p != CNIL && key < n[p].key) {
+		compact_cut(h, x, p);
+		// cascading cut, iteratively
+		for(uint32_t q = p; (p = n[q].parent) != CNIL; q = p) {
+			if(!(n[q].degmark & CMARK)) {
+				n[q].degmark |= CMARK;
+				break;
+			}
+			compact_cut(h, q, p);
+		}
+	}
+	if(key < n[h -> min].key)
+		h -> min = x;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Build an n-item heap in both layouts, then time the first extract-min
+// (which consolidates all n singleton roots) and m further extract-mins,
+// each after a decrease-key on a random live item
+int bench_compact(long n, long m) {
+	if(m > n - 1)
+		m = n - 1;
+	double *lat = (double *)malloc(m * sizeof(double));
+	char *gone = (char *)calloc(n, 1);
+	printf("%ld items, %ld extract-min (each after one decrease-key)\n", n, m);
+	printf("%-8s %10s %9s %10s %9s %9s %9s %10s\n", "layout", "bytes/item", "insert s",
+	       "first ext", "mean us", "p50 us", "p99 us", "max us");
+
+	for(int compact = 0; compact < 2; compact++) {
+		uint64_t seed = 11;
+		compact_heap ch;
+		fheap fh;
+		node **handle = NULL;
+		memset(gone, 0, n);
+
+		double t = now_sec();
+		if(compact) {
+			compact_init(&ch, (uint32_t)n);
+			for(long i = 0; i < n; i++)
+				compact_insert(&ch, (int)(bench_rand(&seed) % 1000000000));
+		} else {
+			init_heap(&fh);
+			handle = (node **)malloc(n * sizeof(node *));
+			for(long i = 0; i < n; i++)
+				handle[i] = insert_item(&fh, (int)(bench_rand(&seed) % 1000000000), (int)i);
+		}
+		double insert_time = now_sec() - t;
+		double bytes = compact ? (double)ch.cap * sizeof(cnode) / n : (double)node_pool.bytes / n;
+
+		uint32_t x;
+		int id;
+		t = now_sec();
+		if(compact)
+			compact_extract_min(&ch, &x);
+		else
+			extract_minimum_id(&fh, &id);
+		double first = now_sec() - t;
+		gone[compact ? (long)x : id] = 1;
+
+		long sum = 0;
+		for(long i = 0; i < m; i++) {
+			uint64_t r = bench_rand(&seed);
+			long v = (long)((r >> 24) % n);
+			int key = (int)(r % 1000000000);
+			t = now_sec();
+			if(!gone[v]) {
+				if(compact)
+					compact_decrease_key(&ch, (uint32_t)v, key);
+				else
+					decrease_key(&fh, handle[v], key);
+			}
+			if(compact) {
+				sum += compact_extract_min(&ch, &x);
+				gone[x] = 1;
+			} else {
+				sum += extract_minimum_id(&fh, &id);
+				gone[id] = 1;
+			}
+			lat[i] = now_sec() - t;
+		}
+		double total = 0;
+		for(long i = 0; i < m; i++)
+			total += lat[i];
+		qsort(lat, m, sizeof(double), compare_double);
+
+		printf("%-8s %10.1f %9.2f %9.2fs %9.2f %9.2f %9.2f %10.1f  (sum %ld)\n",
+		       compact ? "compact" : "pointer", bytes, insert_time, first, total / m * 1e6,
+		       lat[m / 2] * 1e6, lat[m * 99 / 100] * 1e6, lat[m - 1] * 1e6, sum);
+
+		if(compact)
+			compact_destroy(&ch);
+		else {
+			free(handle);
+			pool_destroy(&node_pool);
+		}
+	}
+	free(lat);
+	free(gone);
+	return 0;
+}
+
+// Weighted graph in compressed sparse row form: the arcs leaving vertex u
+// are target[first[u] .. first[u + 1] - 1] with the matching weights
+typedef struct graph {
+	int n;
+	long m;		// arcs
+	long *first;
+	int *target;
+	int *weight;
+} graph;
+
+// Arcs collected before they are sorted into CSR order
+typedef struct arc_list {
+	int *from;
+	int *to;
+	int *weight;
+	long len;
+	long cap;
+} arc_list;
+
+void add_arc(arc_list *a, int from, int to, int weight) {
+	if(a -> len == a -> cap) {
+		a -> cap = a -> cap ? a -> cap * 2 : 1024;
+		a -> from = (int *)realloc(a -> from, a -> cap * sizeof(int));
+		a -> to = (int *)realloc(a -> to, a -> cap * sizeof(int));
+		a -> weight = (int *)realloc(a -> weight, a -> cap * sizeof(int));
+	}
+	a -> from[a -> len] = from;
+	a -> to[a -> len] = to;
+	a -> weight[a -> len] = weight;
+	a -> len++;
+}
+
+// Counting sort of the arcs by source vertex (frees the arc list)
+graph build_csr(int n, arc_list *a) {
+	graph g = {n, a -> len, (long *)calloc(n + 1, sizeof(long)),
+	           (int *)malloc(a -> len * sizeof(int)), (int *)malloc(a -> len * sizeof(int))};
+	for(long i = 0; i < a -> len; i++)
+		g.first[a -> from[i] + 1]++;
+	for(int u = 0; u < n; u++)
+		g.first[u + 1] += g.first[u];
+	long *next = (long *)malloc(n * sizeof(long));
+	memcpy(next, g.first, n * sizeof(long));
+	for(long i = 0; i < a -> len; i++) {
+		long k = next[a -> from[i]]++;
+		g.target[k] = a -> to[i];
+		g.weight[k] = a -> weight[i];
+	}
+	free(next);
+	free(a -> from);
+	free(a -> to);
+	free(a -> weight);
+	return g;
+}
+
+void free_graph(graph *g) {
+	free(g -> first);
+	free(g -> target);
+	free(g -> weight);
+}
+
+// Load a DIMACS shortest-path file ("p sp n m", then "a u v w" arcs with
+// 1-based vertices) or a plain edge list ("u v [w]" per line, 0-based,
+// weight 1 if missing, each edge added in both directions). Lines
+// starting with 'c' or '#' are comments. Returns false on a parse error.
+bool load_graph(const char *path, graph *g) {
+	FILE *f = fopen(path, "r");
+	if(!f) {
+		perror(path);
+		return false;
+	}
+
+	arc_list a = {0};
+	char line[256];
+	int n = 0;
+	bool dimacs = false;
+	long lineno = 0;
+	while(fgets(line, sizeof(line), f)) {
+		lineno++;
+		char *s = line;
+		while(*s == ' ' || *s == '\t')
+			s++;
+		if(*s == 'c' || *s == '#' || *s == '\n' || !*s)
+			continue;
+		long u, v, w = 1;
+		if(*s == 'p') {
+			long m;
+			if(sscanf(s, "p sp %d %ld", &n, &m) != 2 || n <= 0)
+				break;
+			dimacs = true;
+			continue;
+		}
+		int fields = dimacs ? sscanf(s, "a %ld %ld %ld", &u, &v, &w)
+		                    : sscanf(s, "%ld %ld %ld", &u, &v, &w);
+		if(fields < (dimacs ? 3 : 2))
+			break;
+		u -= dimacs;
+		v -= dimacs;
+		if(u < 0 || v < 0 || u >= INT_MAX || v >= INT_MAX || w < 0 || w > INT_MAX ||
+		   (dimacs && (u >= n || v >= n)))
+			break;
+		add_arc(&a, (int)u, (int)v, (int)w);
+		if(!dimacs) {
+			add_arc(&a, (int)v, (int)u, (int)w);
+			if(u >= n)
+				n = (int)u + 1;
+			if(v >= n)
+				n = (int)v + 1;
+		}
+	}
+	bool ok = !ferror(f) && feof(f);
+	fclose(f);
+	if(!ok) {
+		fprintf(stderr, "%s:%ld: cannot parse line\n", path, lineno);
+		free(a.from);
+		free(a.to);
+		free(a.weight);
+		return false;
+	}
+	*g = build_csr(n, &a);
+	return true;
+}
+
+// Road-network-like graph: a side x side grid with 4-neighbour edges of
+// random weight 1..1000 in both directions
+graph grid_graph(int side, uint64_t seed) {
+	arc_list a = {0};
+	for(int y = 0; y < side; y++) {
+		for(int x = 0; x < side; x++) {
+			int u = y * side + x;
+			if(x + 1 < side) {
+				int w = 1 + (int)(bench_rand(&seed) % 1000);
+				add_arc(&a, u, u + 1, w);
+				add_arc(&a, u + 1, u, w);
+			}
+			if(y + 1 < side) {
+				int w = 1 + (int)(bench_rand(&seed) % 1000);
+				add_arc(&a, u, u + side, w);
+				add_arc(&a, u + side, u, w);
+			}
+		}
+	}
+	return build_csr(side * side, &a);
+}
+
+// Random graph: n vertices, each with degree random undirected edges of
+// weight 1..1000 (so about 2 * degree arcs per vertex)
+graph random_graph(int n, int degree, uint64_t seed) {
+	arc_list a = {0};
+	for(int u = 0; u < n; u++) {
+		for(int e = 0; e < degree; e++) {
+			uint64_t r = bench_rand(&seed);
+			int v = (int)((r >> 32) % n), w = 1 + (int)(r % 1000);
+			add_arc(&a, u, v, w);
+			add_arc(&a, v, u, w);
+		}
+	}
+	return build_csr(n, &a);
+}
+
+// Write g as a DIMACS shortest-path file
+bool write_dimacs(const char *path, const graph *g) {
+	FILE *f = fopen(path, "w");
+	if(!f) {
+		perror(path);
+		return false;
+	}
+	fprintf(f, "c generated by 612303041_7_code\np sp %d %ld\n", g -> n, g -> m);
+	for(int u = 0; u < g -> n; u++)
+		for(long k = g -> first[u]; k < g -> first[u + 1]; k++)
+			fprintf(f, "a %d %d %d\n", u + 1, g -> target[k] + 1, g -> weight[k]);
+	bool ok = !ferror(f);
+	return fclose(f) == 0 && ok;
+}
+
+// Heap operation counts of one Dijkstra or Prim run
+typedef struct search_stats {
+	long inserts;
+	long decreases;
+	long extracts;
+	double seconds;
+	long long total;	// sum of distances, or spanning forest weight
+	long reached;
+} search_stats;
+
+// Single-source shortest paths with the heap's handles indexed by vertex
+// id. Distances are heap keys, so they must fit in an int; returns false
+// if one does not.
+bool dijkstra(const pq_engine *e, const graph *g, int source, search_stats *st) {
+	int n = g -> n;
+	pq_handle *handle = (pq_handle *)malloc(n * sizeof(pq_handle));
+	long *dist = (long *)malloc(n * sizeof(long));
+	char *done = (char *)calloc(n, 1);
+	for(int v = 0; v < n; v++)
+		dist[v] = LONG_MAX;
+	*st = (search_stats) {0};
+	bool ok = true;
+
+	double t = now_sec();
+	void *q = e -> create();
+	dist[source] = 0;
+	handle[source] = e -> insert(q, 0, source);
+	st -> inserts++;
+	while(st -> extracts < st -> inserts) {
+		int u;
+		long d = e -> extract_min(q, &u);
+		st -> extracts++;
+		done[u] = 1;
+		st -> total += d;
+		for(long k = g -> first[u]; k < g -> first[u + 1]; k++) {
+			int v = g -> target[k];
+			long nd = d + g -> weight[k];
+			if(done[v] || nd >= dist[v])
+				continue;
+			if(nd > INT_MAX) {
+				ok = false;
+				continue;
+			}
+			if(dist[v] == LONG_MAX) {
+				handle[v] = e -> insert(q, (int)nd, v);
+				st -> inserts++;
+			} else {
+				e -> decrease_key(q, handle[v], (int)nd);
+				st -> decreases++;
+			}
+			dist[v] = nd;
+		}
+	}
+	st -> seconds = now_sec() - t;
+	st -> reached = st -> extracts;
+
+	e -> destroy(q);
+	e -> release();
+	free(handle);
+	free(dist);
+	free(done);
+	return ok;
+}
+
+// Minimum spanning forest (Prim, restarted from each vertex not yet
+// reached); the graph must hold every edge in both directions
+void prim(const pq_engine *e, const graph *g, search_stats *st) {
+	int n = g -> n;
+	pq_handle *handle = (pq_handle *)malloc(n * sizeof(pq_handle));
+	int *key = (int *)malloc(n * sizeof(int));
+	char *state = (char *)calloc(n, 1);	// 0 unseen, 1 queued, 2 in tree
+	*st = (search_stats) {0};
+
+	double t = now_sec();
+	void *q = e -> create();
+	for(int root = 0; root < n; root++) {
+		if(state[root])
+			continue;
+		key[root] = 0;
+		handle[root] = e -> insert(q, 0, root);
+		state[root] = 1;
+		st -> inserts++;
+		while(st -> extracts < st -> inserts) {
+			int u;
+			st -> total += e -> extract_min(q, &u);
+			st -> extracts++;
+			state[u] = 2;
+			for(long k = g -> first[u]; k < g -> first[u + 1]; k++) {
+				int v = g -> target[k], w = g -> weight[k];
+				if(state[v] == 0) {
+					key[v] = w;
+					handle[v] = e -> insert(q, w, v);
+					state[v] = 1;
+					st -> inserts++;
+				} else if(state[v] == 1 && w < key[v]) {
+					key[v] = w;
+					e -> decrease_key(q, handle[v], w);
+					st -> decreases++;
+				}
+			}
+		}
+	}
+	st -> seconds = now_sec() - t;
+	st -> reached = st -> extracts;
+
+	e -> destroy(q);
+	e -> release();
+	free(handle);
+	free(key);
+	free(state);
+}
+
+void print_search(const char *algo, const char *engine, const search_stats *st) {
+	long ops = st -> inserts + st -> decreases + st -> extracts;
+	printf("%-8s %-10s %8.3f s  %9ld inserts %9ld decrease-keys %9ld extracts  %6.2f M heap ops/s  total %lld\n",
+	       algo, engine, st -> seconds, st -> inserts, st -> decreases, st -> extracts,
+	       ops / st -> seconds / 1e6, st -> total);
+}
+
+// Build the graph named by args: "grid <side>", "random <n> <degree>" or
+// a DIMACS / edge-list file; returns the number of args used, 0 on error
+int make_graph(int argc, char **argv, graph *g) {
+	if(argc >= 1 && !strcmp(argv[0], "grid")) {
+		*g = grid_graph(argc > 1 ? atoi(argv[1]) : 1000, 1);
+		return argc > 1 ? 2 : 1;
+	}
+	if(argc >= 1 && !strcmp(argv[0], "random")) {
+		*g = random_graph(argc > 1 ? atoi(argv[1]) : 1000000, argc > 2 ? atoi(argv[2]) : 4, 1);
+		return argc > 2 ? 3 : argc;
+	}
+	if(argc >= 1 && load_graph(argv[0], g))
+		return 1;
+	return 0;
+}
+
+// "graph <spec> [source]" runs Dijkstra and Prim on the Fibonacci heap,
+// with the 4-ary heap as a baseline and cross-check; "graph write <file>
+// <spec>" saves a generated graph in DIMACS format
+int graph_main(int argc, char **argv) {
+	graph g;
+	if(argc > 0 && !strcmp(argv[0], "write")) {
+		if(argc < 3 || !make_graph(argc - 2, argv + 2, &g))
+			return 1;
+		bool ok = write_dimacs(argv[1], &g);
+		free_graph(&g);
+		return ok ? 0 : 1;
+	}
+
+	double t = now_sec();
+	int used = make_graph(argc, argv, &g);
+	if(!used) {
+		fprintf(stderr, "usage: graph {grid <side> | random <n> <degree> | <file>} [source]\n");
+		return 1;
+	}
+	int source = argc > used ? atoi(argv[used]) : 0;
+	printf("%d vertices, %ld arcs, built in %.2f s, %.1f MB CSR\n", g.n, g.m, now_sec() - t,
+	       ((g.n + 1) * sizeof(long) + g.m * 2 * sizeof(int)) / 1048576.0);
+	if(source < 0 || source >= g.n) {
+		fprintf(stderr, "source %d out of range\n", source);
+		free_graph(&g);
+		return 1;
+	}
+
+	const pq_engine *engines[] = {&fib_engine, &pq_dary_engine};
+	search_stats st[2];
+	for(int i = 0; i < 2; i++) {
+		if(!dijkstra(engines[i], &g, source, &st[i]))
+			printf("distances overflow int keys\n");
+		print_search("dijkstra", engines[i] -> name, &st[i]);
+	}
+	printf("%ld vertices reached%s\n", st[0].reached, st[0].total != st[1].total ? ", ENGINES DISAGREE" : "");
+	for(int i = 0; i < 2; i++) {
+		prim(engines[i], &g, &st[i]);
+		print_search("prim", engines[i] -> name, &st[i]);
+	}
+	if(st[0].total != st[1].total)
+		printf("ENGINES DISAGREE\n");
+
+	free_graph(&g);
+	return 0;
+}
+
+// ---- Concurrent front ends ----
+// Both keep an id -> node map so a thread can decrease or look up an item
+// by id without holding a pointer that another thread's extract may free.
+
+// Insert through the map
+node *insert_mapped(fheap *fh, node **handles, int key, int id) {
+	node *n = insert_item(fh, key, id);
+	handles[id] = n;
+	return n;
+}
+
+// Decrease by id; a no-op if the item has already been extracted
+void decrease_mapped(fheap *fh, node **handles, int id, int key) {
+	if(handles[id])
+		decrease_key(fh, handles[id], key);
+}
+
+// Extract the minimum and clear its map entry (unless the id has since
+// been reinserted); INT_MIN and id -1 if the heap is empty
+int extract_mapped(fheap *fh, node **handles, int *id) {
+	if(!fh -> minode) {
+		*id = -1;
+		return INT_MIN;
+	}
+	node *min = fh -> minode;
+	int key = extract_minimum_id(fh, id);
+	if(handles[*id] == min)
+		handles[*id] = NULL;
+	return key;
+}
+
+// Plain mutex wrapper
+typedef struct locked_heap {
+	pthread_mutex_t lock;
+	fheap heap;
+	node **handles;
+} locked_heap;
+
+void locked_init(locked_heap *lh, int max_id) {
+	pthread_mutex_init(&lh -> lock, NULL);
+	init_heap(&lh -> heap);
+	lh -> handles = (node **)calloc(max_id, sizeof(node *));
+}
+
+void locked_insert(locked_heap *lh, int key, int id) {
+	pthread_mutex_lock(&lh -> lock);
+	insert_mapped(&lh -> heap, lh -> handles, key, id);
+	pthread_mutex_unlock(&lh -> lock);
+}
+
+void locked_decrease_key(locked_heap *lh, int id, int key) {
+	pthread_mutex_lock(&lh -> lock);
+	decrease_mapped(&lh -> heap, lh -> handles, id, key);
+	pthread_mutex_unlock(&lh -> lock);
+}
+
+int locked_extract_min(locked_heap *lh, int *id) {
+	pthread_mutex_lock(&lh -> lock);
+	int key = extract_mapped(&lh -> heap, lh -> handles, id);
+	pthread_mutex_unlock(&lh -> lock);
+	return key;
+}
+
+void locked_destroy(locked_heap *lh) {
+	pthread_mutex_destroy(&lh -> lock);
+	free(lh -> handles);
+}
+
+// Flat combining: each thread owns a slot and publishes one request at a
+// time in it. Whichever waiting thread takes the combiner flag applies
+// every published request, so the heap stays single-threaded and hot in
+// one cache, and concurrent inserts are linked into one chain and spliced
+// into the root list with a single merge.
+
+#define FC_MAX_THREADS 128
+#define FC_PASSES 4		// combining passes per turn while requests keep coming
+
+enum { FC_IDLE, FC_INSERT, FC_DECREASE, FC_EXTRACT };
+
+typedef struct fc_slot {
+	atomic_int op;		// request, reset to FC_IDLE by the combiner when done
+	int key;
+	int id;				// in: item id; out: extracted id
+} __attribute__((aligned(64))) fc_slot;
+
+typedef struct fc_heap {
+	atomic_flag combining;
+	atomic_int nslots;
+	fheap heap;
+	node **handles;
+	long combines;		// combiner turns
+	long applied;		// requests applied
+	fc_slot slots[FC_MAX_THREADS];
+} fc_heap;
+
+void fc_init(fc_heap *fc, int max_id) {
+	atomic_flag_clear(&fc -> combining);
+	atomic_init(&fc -> nslots, 0);
+	init_heap(&fc -> heap);
+	fc -> handles = (node **)calloc(max_id, sizeof(node *));
+	fc -> combines = fc -> applied = 0;
+	for(int i = 0; i < FC_MAX_THREADS; i++)
+		atomic_init(&fc -> slots[i].op, FC_IDLE);
+}
+
+// Claim a slot for the calling thread
+fc_slot *fc_register(fc_heap *fc) {
+	int i = atomic_fetch_add(&fc -> nslots, 1);
+	if(i >= FC_MAX_THREADS) {
+		fprintf(stderr, "fc_register: more than %d threads\n", FC_MAX_THREADS);
+		exit(1);
+	}
+	return &fc -> slots[i];
+}
+
+// Apply every published request: inserts first as one spliced chain,
+// then decreases and extracts. All of them were pending at once, so any
+// order is a valid linearization. Another pass follows while passes pick
+// up requests from other threads.
+void fc_combine(fc_heap *fc) {
+	fc_slot *pending[FC_MAX_THREADS];
+	fc -> combines++;
+	for(int pass = 0; pass < FC_PASSES; pass++) {
+		int n = atomic_load_explicit(&fc -> nslots, memory_order_acquire);
+		int npending = 0;
+		fheap batch;
+		init_heap(&batch);
+
+		for(int i = 0; i < n; i++) {
+			fc_slot *s = &fc -> slots[i];
+			int op = atomic_load_explicit(&s -> op, memory_order_acquire);
+			if(op == FC_INSERT) {
+				fc -> handles[s -> id] = insert_item(&batch, s -> key, s -> id);
+				atomic_store_explicit(&s -> op, FC_IDLE, memory_order_release);
+				fc -> applied++;
+			} else if(op != FC_IDLE)
+				pending[npending++] = s;
+		}
+		if(!fc -> heap.minode)
+			fc -> heap = batch;
+		else
+			merge(&fc -> heap, &batch);
+
+		for(int i = 0; i < npending; i++) {
+			fc_slot *s = pending[i];
+			if(atomic_load_explicit(&s -> op, memory_order_relaxed) == FC_DECREASE)
+				decrease_mapped(&fc -> heap, fc -> handles, s -> id, s -> key);
+			else
+				s -> key = extract_mapped(&fc -> heap, fc -> handles, &s -> id);
+			atomic_store_explicit(&s -> op, FC_IDLE, memory_order_release);
+		}
+		fc -> applied += npending;
+
+		if(batch.nodes + npending <= 1)
+			break;
+	}
+}
+
+// Publish a request and wait until some combiner (possibly this thread)
+// has applied it
+void fc_request(fc_heap *fc, fc_slot *s, int op) {
+	atomic_store_explicit(&s -> op, op, memory_order_release);
+	int spins = 0;
+	while(atomic_load_explicit(&s -> op, memory_order_acquire) != FC_IDLE) {
+		if(!atomic_flag_test_and_set_explicit(&fc -> combining, memory_order_acquire)) {
+			fc_combine(fc);
+			atomic_flag_clear_explicit(&fc -> combining, memory_order_release);
+		} else if(++spins > 32) {
+			sched_yield();
+			spins = 0;
+		}
+	}
+}
+
+void fc_insert(fc_heap *fc, fc_slot *s, int key, int id) {
+	s -> key = key;
+	s -> id = id;
+	fc_request(fc, s, FC_INSERT);
+}
+
+void fc_decrease_key(fc_heap *fc, fc_slot *s, int id, int key) {
+	s -> key = key;
+	s -> id = id;
+	fc_request(fc, s, FC_DECREASE);
+}
+
+int fc_extract_min(fc_heap *fc, fc_slot *s, int *id) {
+	fc_request(fc, s, FC_EXTRACT);
+	*id = s -> id;
+	return s -> key;
+}
+
+void fc_destroy(fc_heap *fc) {
+	free(fc -> handles);
+}
+
+// Scheduler-style workload: each thread submits tasks under its own ids
+// (50%), reprioritizes one of them (25%) and takes the most urgent task
+// in the heap (25%)
+#define FC_IDS_PER_THREAD 4096
+
+typedef struct fc_worker {
+	fc_heap *fc;			// one of these two
+	locked_heap *lh;
+	int thread;
+	long ops;
+	long inserted;
+	long extracted;
+} fc_worker;
+
+void *fc_worker_thread(void *arg) {
+	fc_worker *w = (fc_worker *)arg;
+	fc_slot *slot = w -> fc ? fc_register(w -> fc) : NULL;
+	uint64_t seed = 0x9E3779B97F4A7C15ULL * (w -> thread + 1);
+	int base = w -> thread * FC_IDS_PER_THREAD, next = 0;
+	int now = 0;
+
+	for(long op = 0; op < w -> ops; op++) {
+		uint64_t r = bench_rand(&seed);
+		int kind = (int)(r & 3), id;
+		int key = now + (int)((r >> 32) % 100000);
+		if(kind < 2) {
+			id = base + next;
+			next = (next + 1) % FC_IDS_PER_THREAD;
+			if(w -> fc)
+				fc_insert(w -> fc, slot, key, id);
+			else
+				locked_insert(w -> lh, key, id);
+			w -> inserted++;
+		} else if(kind == 2) {
+			id = base + (int)((r >> 8) % FC_IDS_PER_THREAD);
+			if(w -> fc)
+				fc_decrease_key(w -> fc, slot, id, now);
+			else
+				locked_decrease_key(w -> lh, id, now);
+		} else {
+			int min = w -> fc ? fc_extract_min(w -> fc, slot, &id) : locked_extract_min(w -> lh, &id);
+			if(min != INT_MIN) {
+				w -> extracted++;
+				now = min;
+			}
+		}
+	}
+	return NULL;
+}
+
+// Compare the flat-combining front end with the mutex wrapper from 1 to
+// max_threads threads, ops_per_thread operations each
+int bench_fc(int max_threads, long ops_per_thread) {
+	if(max_threads > FC_MAX_THREADS)
+		max_threads = FC_MAX_THREADS;
+	int max_id = max_threads * FC_IDS_PER_THREAD;
+	printf("%ld operations per thread (M ops/s)\n", ops_per_thread);
+	printf("%7s %10s %10s %12s\n", "threads", "mutex", "combining", "batch size");
+
+	for(int threads = 1; threads <= max_threads; threads *= 2) {
+		double rate[2], batch = 0;
+		for(int combining = 0; combining < 2; combining++) {
+			locked_heap lh;
+			fc_heap *fc = combining ? (fc_heap *)aligned_alloc(64, sizeof(fc_heap)) : NULL;
+			if(combining)
+				fc_init(fc, max_id);
+			else
+				locked_init(&lh, max_id);
+
+			pthread_t tid[FC_MAX_THREADS];
+			fc_worker w[FC_MAX_THREADS];
+			double t = now_sec();
+			for(int i = 0; i < threads; i++) {
+				w[i] = (fc_worker) {fc, &lh, i, ops_per_thread, 0, 0};
+				pthread_create(&tid[i], NULL, fc_worker_thread, &w[i]);
+			}
+			long inserted = 0, extracted = 0;
+			for(int i = 0; i < threads; i++) {
+				pthread_join(tid[i], NULL);
+				inserted += w[i].inserted;
+				extracted += w[i].extracted;
+			}
+			rate[combining] = threads * ops_per_thread / (now_sec() - t) / 1e6;
+
+			// what is left must drain in order and match the counts
+			fheap *fh = combining ? &fc -> heap : &lh.heap;
+			node **handles = combining ? fc -> handles : lh.handles;
+			long left = 0;
+			int prev = INT_MIN, id;
+			bool out_of_order = false;
+			while(fh -> minode) {
+				int key = extract_mapped(fh, handles, &id);
+				out_of_order |= key < prev;
+				prev = key;
+				left++;
+			}
+			if(out_of_order || left != inserted - extracted)
+				printf("%s with %d threads: heap lost or reordered items\n",
+				       combining ? "combining" : "mutex", threads);
+
+			if(combining) {
+				batch = fc -> combines ? (double)fc -> applied / fc -> combines : 0;
+				fc_destroy(fc);
+				free(fc);
+			} else
+				locked_destroy(&lh);
+			pool_destroy(&node_pool);
+		}
+		printf("%7d %10.2f %10.2f %12.1f\n", threads, rate[0], rate[1], batch);
+	}
+	return 0;
+}
+
+// "bench pq [ids]" runs the pq.h traces through the Fibonacci heap and
+// the pq.h engines, "bench fc [max threads] [ops per thread]" compares
+// flat combining with a mutex, "bench compact [items] [extracts]" compares
+// the pointer and compact layouts, "graph ..." runs the graph drivers
+// (see graph_main)
+int main(int argc, char **argv) {
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "compact"))
+		return bench_compact(argc > 3 ? atol(argv[3]) : 50000000, argc > 4 ? atol(argv[4]) : 1000000);
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "fc"))
+		return bench_fc(argc > 3 ? atoi(argv[3]) : 64, argc > 4 ? atol(argv[4]) : 200000);
+	if(argc > 1 && !strcmp(argv[1], "graph"))
+		return graph_main(argc - 2, argv + 2);
+	if(argc > 2 && !strcmp(argv[1], "bench") && !strcmp(argv[2], "pq")) {
+		const pq_engine *engines[] = {&fib_engine, &pq_pairing_engine, &pq_dary_engine, &pq_radix_engine};
+		return pq_bench(engines, 4, argc > 3 ? atoi(argv[3]) : 1000000);
+	}
+
 	fheap *h1 = (fheap *)malloc(sizeof(fheap));
 	fheap *h2 = (fheap *)malloc(sizeof(fheap));
 	init_heap(h1);
@@ -282,6 +1334,7 @@ int main() {
 	printf("Min after decrease: %d\n", find_min(merged));
 
 	free(merged);
+	pool_destroy(&node_pool);
 	return 0;
 }
 
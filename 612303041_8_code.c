@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "pool.h"
+#include "bench.h"
 
 #define ASCII 128
 #define TEXT_SIZE 1000
@@ -18,10 +22,13 @@ typedef struct min_heap {
 	node **heap;
 } min_heap;
 
+// All Huffman tree nodes come from this pool and are released together
+static pool node_pool = POOL_INIT(node);
+
 
 // Allocates and initializes a new node
 node *create_node(char c, int freq) {
-	node *nn = (node *)malloc(sizeof(node));
+	node *nn = (node *)pool_alloc(&node_pool);
 	nn -> c = c;
 	nn -> freq = freq;
 	nn -> lchild = NULL;
@@ -108,23 +115,29 @@ node *build_huffman_tree(min_heap *h, int *freq) {
 
 // Compresses text using the generated Huffman codes
 char *compress(char *text, char **codes) {
-	int total_len = 0;
+	size_t total_len = 0;
 
 	// Calculate total length of compressed bit string
-	for(int i = 0; text[i]; i++) {
-		if (codes[text[i]])
-			total_len += strlen(codes[text[i]]);
+	for(size_t i = 0; text[i]; i++) {
+		if (codes[(unsigned char)text[i]])
+			total_len += strlen(codes[(unsigned char)text[i]]);
 	}
 
 	// Allocate output string
 	char *compressed_text = (char *)malloc(total_len + 1);
-	compressed_text[0] = '\0';
 
-	// Append each character’s binary code
-	for(int i = 0; text[i]; i++) {
-		if (codes[text[i]])
-			strcat(compressed_text, codes[text[i]]);
+	// Append each character’s binary code (at the end pointer: strcat
+	// would rescan the whole output every time)
+	char *end = compressed_text;
+	for(size_t i = 0; text[i]; i++) {
+		const char *code = codes[(unsigned char)text[i]];
+		if (code) {
+			size_t len = strlen(code);
+			memcpy(end, code, len);
+			end += len;
+		}
 	}
+	*end = '\0';
 
 	return compressed_text;
 }
@@ -181,8 +194,268 @@ void get_codes(node *root, char **codes, char *path, int depth) {
 	get_codes(root -> rchild, codes, path, depth + 1);
 }
 
+// Bit-packed coding: codes live in integer tables and are written into a
+// 64-bit accumulator, most significant bit first, which is flushed to the
+// output a whole word at a time. The packed stream holds the same bits as
+// the '0'/'1' string from compress(), eight to a byte.
+
+// The code of symbol s is the low len[s] bits of code[s]
+typedef struct code_table {
+	uint64_t code[ASCII];
+	int len[ASCII];
+} code_table;
+
+// Fill the table from the tree (depth is the code length so far). A
+// tree that is a single leaf gets the 1-bit code 0.
+void build_code_table(node *root, code_table *t, uint64_t path, int depth) {
+	if(!root)
+		return;
+	if(!root -> lchild && !root -> rchild) {
+		t -> code[(unsigned char)root -> c] = path;
+		t -> len[(unsigned char)root -> c] = depth ? depth : 1;
+		return;
+	}
+	build_code_table(root -> lchild, t, path << 1, depth + 1);
+	build_code_table(root -> rchild, t, path << 1 | 1, depth + 1);
+}
+
+static inline void put_be64(unsigned char *p, uint64_t x) {
+	x = __builtin_bswap64(x);
+	memcpy(p, &x, 8);
+}
+
+static inline uint64_t get_be64(const unsigned char *p) {
+	uint64_t x;
+	memcpy(&x, p, 8);
+	return __builtin_bswap64(x);
+}
+
+// Bits needed to encode text (codes are at most 64 bits: with int
+// frequencies a Huffman tree is under 50 levels deep)
+uint64_t encoded_bits(const int *freq, const code_table *t) {
+	uint64_t bits = 0;
+	for(int s = 0; s < ASCII; s++)
+		bits += (uint64_t)freq[s] * t -> len[s];
+	return bits;
+}
+
+// Encode n symbols into out, which needs room for encoded_bits rounded
+// up to whole 64-bit words; returns the bytes written
+size_t encode(const unsigned char *text, size_t n, const code_table *t, unsigned char *out) {
+	unsigned char *start = out;
+	uint64_t acc = 0;
+	int used = 0;		// bits of acc filled, from the top
+	for(size_t i = 0; i < n; i++) {
+		uint64_t code = t -> code[text[i]];
+		int len = t -> len[text[i]];
+		if(used + len < 64) {
+			acc |= code << (64 - used - len);
+			used += len;
+		} else {
+			// fill the word with the top bits of the code, flush it and
+			// start the next one with the rest
+			int rest = len - (64 - used);
+			acc |= code >> rest;
+			put_be64(out, acc);
+			out += 8;
+			acc = rest ? code << (64 - rest) : 0;
+			used = rest;
+		}
+	}
+	for(; used > 0; used -= 8) {
+		*out++ = (unsigned char)(acc >> 56);
+		acc <<= 8;
+	}
+	return out - start;
+}
+
+// Decoding looks up the next DECODE_BITS bits in a table: codes that
+// short give their symbol and length directly, longer ones give the tree
+// node reached after DECODE_BITS bits and finish bit by bit
+#define DECODE_BITS 11
+
+typedef struct decode_entry {
+	node *next;		// NULL for a symbol entry
+	unsigned char sym;
+	unsigned char len;
+} decode_entry;
+
+void build_decode_table(node *n, decode_entry *tab, uint32_t prefix, int depth) {
+	if(!n -> lchild && !n -> rchild) {
+		uint32_t first = prefix << (DECODE_BITS - depth), count = 1u << (DECODE_BITS - depth);
+		unsigned char len = depth ? depth : 1;
+		for(uint32_t i = 0; i < count; i++)
+			tab[first + i] = (decode_entry) {NULL, (unsigned char)n -> c, len};
+	} else if(depth == DECODE_BITS) {
+		tab[prefix] = (decode_entry) {n, 0, 0};
+	} else {
+		build_decode_table(n -> lchild, tab, prefix << 1, depth + 1);
+		build_decode_table(n -> rchild, tab, prefix << 1 | 1, depth + 1);
+	}
+}
+
+// Decode n symbols; in must be readable for 8 bytes past the stream
+void decode(const decode_entry *tab, const unsigned char *in, size_t n, unsigned char *out) {
+	uint64_t pos = 0;
+	for(size_t i = 0; i < n; i++) {
+		uint64_t w = get_be64(in + (pos >> 3)) << (pos & 7);
+		decode_entry e = tab[w >> (64 - DECODE_BITS)];
+		if(!e.next) {
+			out[i] = e.sym;
+			pos += e.len;
+			continue;
+		}
+		node *c = e.next;
+		pos += DECODE_BITS;
+		while(c -> lchild || c -> rchild) {
+			int bit = (in[pos >> 3] >> (7 - (pos & 7))) & 1;
+			c = bit ? c -> rchild : c -> lchild;
+			pos++;
+		}
+		out[i] = (unsigned char)c -> c;
+	}
+}
+
+// English-like input: words drawn from a small vocabulary with a skewed
+// distribution, separated by spaces and the odd punctuation mark
+void make_text(unsigned char *text, size_t n) {
+	static const char *words[] = {
+		"the", "of", "and", "to", "a", "in", "that", "is", "was", "he", "for", "it", "with",
+		"as", "his", "on", "be", "at", "by", "had", "not", "are", "but", "from", "or",
+		"have", "an", "they", "which", "one", "you", "were", "her", "all", "she", "there",
+		"would", "their", "we", "him", "been", "has", "when", "who", "will", "more", "no",
+		"if", "out", "so", "said", "what", "up", "its", "about", "into", "than", "them",
+		"can", "only", "other", "new", "some", "could", "time", "these", "two", "may",
+		"then", "do", "first", "any", "my", "now", "such", "like", "our", "over", "man",
+		"me", "even", "most", "made", "after", "also", "did", "many", "before", "must",
+		"through", "back", "years", "where", "much", "your", "way", "well", "down",
+		"should", "because", "each", "just", "those", "people", "Mr", "how", "too",
+		"little", "State", "good", "very", "make", "world", "still", "own", "see", "men",
+		"work", "long", "get", "here", "between", "both", "life", "being", "under",
+		"never", "day", "same", "another", "know", "while", "last", "might", "us", "great",
+		"old", "year", "off", "come", "since", "against", "go", "came", "right", "used",
+		"take", "three", "India", "freedom", "moment", "history", "destiny", "pledge"
+	};
+	int nwords = sizeof(words) / sizeof(words[0]);
+	uint64_t seed = 2024;
+	size_t i = 0;
+	while(i < n) {
+		uint64_t r = bench_rand(&seed);
+		// squaring a uniform index favours the first words
+		uint64_t u = (r >> 40) % nwords;
+		const char *w = words[u * u / nwords];
+		for(; *w && i < n; w++)
+			text[i++] = (unsigned char)*w;
+		if(i < n)
+			text[i++] = (r & 31) == 0 ? ',' : (r & 63) == 1 ? '.' : (r & 255) == 2 ? '\n' : ' ';
+	}
+}
+
+// Encode and decode mb megabytes of text (generated, or read from path
+// with the high bit of each byte cleared) with the ASCII string coder
+// and the bit-packed one
+int bench(double mb, const char *path) {
+	size_t n = (size_t)(mb * 1048576);
+	unsigned char *text;
+	if(path) {
+		FILE *f = fopen(path, "rb");
+		if(!f) {
+			perror(path);
+			return 1;
+		}
+		fseek(f, 0, SEEK_END);
+		n = (size_t)ftell(f);
+		fseek(f, 0, SEEK_SET);
+		text = (unsigned char *)malloc(n + 1);
+		n = fread(text, 1, n, f);
+		fclose(f);
+		for(size_t i = 0; i < n; i++)
+			text[i] &= 0x7f;
+	} else {
+		text = (unsigned char *)malloc(n + 1);
+		make_text(text, n);
+	}
+	if(!n) {
+		fprintf(stderr, "bench: empty input\n");
+		free(text);
+		return 1;
+	}
+	// compress() stops at the first NUL
+	for(size_t i = 0; i < n; i++)
+		if(!text[i])
+			text[i] = ' ';
+	text[n] = '\0';
+
+	int freq[ASCII] = {0};
+	for(size_t i = 0; i < n; i++)
+		freq[text[i]]++;
+	min_heap h;
+	create_heap(&h);
+	node *root = build_huffman_tree(&h, freq);
+
+	code_table t = {{0}, {0}};
+	build_code_table(root, &t, 0, 0);
+	char *codes[ASCII] = {NULL};
+	char path_buf[ASCII];
+	for(int s = 0; s < ASCII; s++) {
+		if(!freq[s])
+			continue;
+		for(int b = 0; b < t.len[s]; b++)
+			path_buf[b] = (t.code[s] >> (t.len[s] - 1 - b)) & 1 ? '1' : '0';
+		path_buf[t.len[s]] = '\0';
+		codes[s] = strdup(path_buf);
+	}
+
+	uint64_t bits = encoded_bits(freq, &t);
+	double in_mb = n / 1048576.0;
+	printf("%.1f MB input, %.3f bits/symbol\n", in_mb, (double)bits / n);
+
+	double start = now_sec();
+	char *ascii = compress((char *)text, codes);
+	double ascii_time = now_sec() - start;
+	printf("ascii string : %8.1f MB out, %8.1f MB/s encode\n",
+	       strlen(ascii) / 1048576.0, in_mb / ascii_time);
+
+	size_t cap = (bits + 63) / 64 * 8 + 8;
+	unsigned char *packed = (unsigned char *)calloc(cap, 1);
+	start = now_sec();
+	size_t bytes = encode(text, n, &t, packed);
+	double encode_time = now_sec() - start;
+
+	// the packed stream must hold exactly the bits of the ASCII string
+	bool same = bytes == (bits + 7) / 8;
+	for(uint64_t b = 0; same && b < bits; b++)
+		same = ascii[b] - '0' == ((packed[b >> 3] >> (7 - (b & 7))) & 1);
+
+	decode_entry *tab = (decode_entry *)malloc(sizeof(decode_entry) << DECODE_BITS);
+	build_decode_table(root, tab, 0, 0);
+	unsigned char *back = (unsigned char *)malloc(n);
+	start = now_sec();
+	decode(tab, packed, n, back);
+	double decode_time = now_sec() - start;
+	bool round_trip = !memcmp(back, text, n);
+
+	printf("bit-packed   : %8.1f MB out, %8.1f MB/s encode, %8.1f MB/s decode, ratio %.3f%s%s\n",
+	       bytes / 1048576.0, in_mb / encode_time, in_mb / decode_time, (double)n / bytes,
+	       same ? "" : "  STREAM DIFFERS FROM ASCII CODES", round_trip ? "" : "  ROUND TRIP FAILED");
+
+	for(int s = 0; s < ASCII; s++)
+		free(codes[s]);
+	free(ascii);
+	free(packed);
+	free(tab);
+	free(back);
+	free(text);
+	free(h.heap);
+	pool_destroy(&node_pool);
+	return !same || !round_trip;
+}
+
+// "bench [MB] [file]" times the string and bit-packed encoders
+int main(int argc, char **argv) {
+	if(argc > 1 && !strcmp(argv[1], "bench"))
+		return bench(argc > 2 ? atof(argv[2]) : 16, argc > 3 ? argv[3] : NULL);
 
-int main(void) {
     char *text = (char *)calloc(TEXT_SIZE, sizeof(char));
 	int len = 0;
 	char buf;
@@ -222,6 +495,7 @@ int main(void) {
 
     free(compressed);
     free(decompressed);
+    pool_destroy(&node_pool);
     return 0;
 }
 
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "pool.h"
 
 // 26 alphabets + 1 special character
 #define ALPHABET_SIZE 27
@@ -15,9 +16,12 @@ typedef struct trie_node {
     struct trie_node *children[ALPHABET_SIZE];
 } trie_node;
 
+// All trie nodes come from this pool and are released together
+static pool node_pool = POOL_INIT(trie_node);
+
 // Creates and initializes a new Trie node
 trie_node *create_node() {
-    trie_node *node = (trie_node *)malloc(sizeof(trie_node));
+    trie_node *node = (trie_node *)pool_alloc(&node_pool);
 
     // Initialize all child pointers to NULL
     for(int i = 0; i < ALPHABET_SIZE; i++) {
@@ -164,6 +168,7 @@ int main(void) {
     printf("\nSuggestions:\n");
     auto_suggest(root, prefix);
 
+    pool_destroy(&node_pool);
     return 0;
 }
 
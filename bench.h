@@ -0,0 +1,56 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+// Small helpers shared by the "bench" modes of the programs in this repo
+
+// Monotonic wall clock in seconds
+static inline double now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Read a "Vm..." field (in kB) from /proc/self/status, 0 if unavailable
+static inline long proc_status_kb(const char *field) {
+	FILE *f = fopen("/proc/self/status", "r");
+	if(!f)
+		return 0;
+
+	char line[256];
+	long kb = 0;
+	size_t len = strlen(field);
+	while(fgets(line, sizeof(line), f)) {
+		if(!strncmp(line, field, len) && line[len] == ':') {
+			sscanf(line + len + 1, "%ld", &kb);
+			break;
+		}
+	}
+	fclose(f);
+	return kb;
+}
+
+// Current and peak resident set size in kB
+static inline long rss_kb(void) {
+	return proc_status_kb("VmRSS");
+}
+
+static inline long peak_rss_kb(void) {
+	return proc_status_kb("VmHWM");
+}
+
+// xorshift64* generator for benchmark inputs (rand() is too slow and too narrow)
+static inline uint64_t bench_rand(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+#endif
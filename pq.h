@@ -0,0 +1,728 @@
+#ifndef PQ_H
+#define PQ_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include "pool.h"
+#include "bench.h"
+
+// One interface over the priority queues in this repo, a few extra engines
+// (pairing heap, 4-ary array heap, monotone radix heap) and a driver that
+// runs identical operation traces through every engine.
+//
+// Keys are ints, ids are the caller's item ids. insert returns a handle
+// that stays valid until the item is extracted (also across meld), and
+// decrease_key takes that handle. find_min and extract_min must not be
+// called on an empty queue. meld moves every item of other into q and
+// leaves other empty. Each engine allocates from pools shared by all of
+// its queues: destroy frees a queue object, release frees the items of
+// every queue of the engine, and bytes reports the memory it holds.
+
+typedef void *pq_handle;
+
+typedef struct pq_engine {
+	const char *name;
+	void *(*create)(void);
+	void (*destroy)(void *q);
+	pq_handle (*insert)(void *q, int key, int id);
+	int (*find_min)(void *q);
+	int (*extract_min)(void *q, int *id);
+	void (*decrease_key)(void *q, pq_handle h, int key);
+	void (*meld)(void *q, void *other);
+	void (*release)(void);
+	size_t (*bytes)(void);
+} pq_engine;
+
+// ---- Pairing heap (two-pass) ----
+
+typedef struct pq_pairing_node {
+	struct pq_pairing_node *child;
+	struct pq_pairing_node *next;	// right sibling
+	struct pq_pairing_node *prev;	// left sibling, or the parent of a first child
+	int key;
+	int id;
+} pq_pairing_node;
+
+typedef struct pq_pairing {
+	pq_pairing_node *root;
+} pq_pairing;
+
+static pool pq_pairing_pool = POOL_INIT(pq_pairing_node);
+
+// Make the root with the larger key the first child of the other
+static inline pq_pairing_node *pq_pairing_link(pq_pairing_node *a, pq_pairing_node *b) {
+	if(b -> key < a -> key) {
+		pq_pairing_node *t = a;
+		a = b;
+		b = t;
+	}
+	b -> prev = a;
+	b -> next = a -> child;
+	if(a -> child)
+		a -> child -> prev = b;
+	a -> child = b;
+	return a;
+}
+
+// Link a sibling list into one tree: pairs left to right, then fold the
+// pairs right to left
+static inline pq_pairing_node *pq_pairing_combine(pq_pairing_node *first) {
+	pq_pairing_node *pairs = NULL;
+	while(first) {
+		pq_pairing_node *a = first, *b = first -> next;
+		if(b) {
+			first = b -> next;
+			a = pq_pairing_link(a, b);
+		} else
+			first = NULL;
+		a -> next = pairs;
+		pairs = a;
+	}
+	if(!pairs)
+		return NULL;
+
+	pq_pairing_node *root = pairs;
+	pairs = pairs -> next;
+	while(pairs) {
+		pq_pairing_node *next = pairs -> next;
+		root = pq_pairing_link(root, pairs);
+		pairs = next;
+	}
+	root -> next = root -> prev = NULL;
+	return root;
+}
+
+static inline void *pq_pairing_create(void) {
+	return calloc(1, sizeof(pq_pairing));
+}
+
+static inline void pq_pairing_destroy(void *q) {
+	free(q);
+}
+
+static inline pq_handle pq_pairing_insert(void *q, int key, int id) {
+	pq_pairing *h = (pq_pairing *)q;
+	pq_pairing_node *n = (pq_pairing_node *)pool_alloc(&pq_pairing_pool);
+	n -> child = n -> next = n -> prev = NULL;
+	n -> key = key;
+	n -> id = id;
+	h -> root = h -> root ? pq_pairing_link(h -> root, n) : n;
+	return n;
+}
+
+static inline int pq_pairing_find_min(void *q) {
+	return ((pq_pairing *)q) -> root -> key;
+}
+
+static inline int pq_pairing_extract_min(void *q, int *id) {
+	pq_pairing *h = (pq_pairing *)q;
+	pq_pairing_node *r = h -> root;
+	int key = r -> key;
+	*id = r -> id;
+	h -> root = pq_pairing_combine(r -> child);
+	pool_free(&pq_pairing_pool, r);
+	return key;
+}
+
+// Cut the node's subtree out and link it with the root
+static inline void pq_pairing_decrease_key(void *q, pq_handle handle, int key) {
+	pq_pairing *h = (pq_pairing *)q;
+	pq_pairing_node *n = (pq_pairing_node *)handle;
+	n -> key = key;
+	if(n == h -> root)
+		return;
+	if(n -> prev -> child == n)
+		n -> prev -> child = n -> next;
+	else
+		n -> prev -> next = n -> next;
+	if(n -> next)
+		n -> next -> prev = n -> prev;
+	n -> next = n -> prev = NULL;
+	h -> root = pq_pairing_link(h -> root, n);
+}
+
+static inline void pq_pairing_meld(void *q, void *other) {
+	pq_pairing *a = (pq_pairing *)q, *b = (pq_pairing *)other;
+	if(!a -> root)
+		a -> root = b -> root;
+	else if(b -> root)
+		a -> root = pq_pairing_link(a -> root, b -> root);
+	b -> root = NULL;
+}
+
+static inline void pq_pairing_release(void) {
+	pool_destroy(&pq_pairing_pool);
+}
+
+static inline size_t pq_pairing_bytes(void) {
+	return pq_pairing_pool.bytes;
+}
+
+static const pq_engine pq_pairing_engine = {
+	"pairing", pq_pairing_create, pq_pairing_destroy, pq_pairing_insert,
+	pq_pairing_find_min, pq_pairing_extract_min, pq_pairing_decrease_key,
+	pq_pairing_meld, pq_pairing_release, pq_pairing_bytes
+};
+
+// ---- 4-ary implicit heap ----
+// The array holds (key, item) pairs so sifting compares keys without
+// following pointers; an item records its array position, which makes
+// the item pointer a stable handle.
+
+#define PQ_ARITY 4
+
+typedef struct pq_dary_item {
+	int pos;
+	int id;
+} pq_dary_item;
+
+typedef struct pq_dary_entry {
+	int key;
+	pq_dary_item *item;
+} pq_dary_entry;
+
+typedef struct pq_dary {
+	pq_dary_entry *a;
+	int n;
+	int cap;
+} pq_dary;
+
+static pool pq_dary_pool = POOL_INIT(pq_dary_item);
+static size_t pq_dary_array_bytes;	// heap arrays of every queue
+
+static inline void pq_dary_sift_up(pq_dary *h, int i, pq_dary_entry e) {
+	while(i > 0) {
+		int p = (i - 1) / PQ_ARITY;
+		if(h -> a[p].key <= e.key)
+			break;
+		h -> a[i] = h -> a[p];
+		h -> a[i].item -> pos = i;
+		i = p;
+	}
+	h -> a[i] = e;
+	e.item -> pos = i;
+}
+
+static inline void pq_dary_sift_down(pq_dary *h, int i, pq_dary_entry e) {
+	for(;;) {
+		int c = PQ_ARITY * i + 1;
+		if(c >= h -> n)
+			break;
+		int best = c, end = c + PQ_ARITY < h -> n ? c + PQ_ARITY : h -> n;
+		for(int j = c + 1; j < end; j++)
+			if(h -> a[j].key < h -> a[best].key)
+				best = j;
+		if(h -> a[best].key >= e.key)
+			break;
+		h -> a[i] = h -> a[best];
+		h -> a[i].item -> pos = i;
+		i = best;
+	}
+	h -> a[i] = e;
+	e.item -> pos = i;
+}
+
+static inline void pq_dary_reserve(pq_dary *h, int n) {
+	if(n <= h -> cap)
+		return;
+	int cap = h -> cap ? h -> cap : 64;
+	while(cap < n)
+		cap *= 2;
+	h -> a = (pq_dary_entry *)realloc(h -> a, cap * sizeof(pq_dary_entry));
+	pq_dary_array_bytes += (cap - h -> cap) * sizeof(pq_dary_entry);
+	h -> cap = cap;
+}
+
+static inline void *pq_dary_create(void) {
+	return calloc(1, sizeof(pq_dary));
+}
+
+static inline void pq_dary_destroy(void *q) {
+	pq_dary *h = (pq_dary *)q;
+	pq_dary_array_bytes -= h -> cap * sizeof(pq_dary_entry);
+	free(h -> a);
+	free(h);
+}
+
+static inline pq_handle pq_dary_insert(void *q, int key, int id) {
+	pq_dary *h = (pq_dary *)q;
+	pq_dary_item *item = (pq_dary_item *)pool_alloc(&pq_dary_pool);
+	item -> id = id;
+	pq_dary_reserve(h, h -> n + 1);
+	pq_dary_sift_up(h, h -> n++, (pq_dary_entry) {key, item});
+	return item;
+}
+
+static inline int pq_dary_find_min(void *q) {
+	return ((pq_dary *)q) -> a[0].key;
+}
+
+static inline int pq_dary_extract_min(void *q, int *id) {
+	pq_dary *h = (pq_dary *)q;
+	pq_dary_entry top = h -> a[0];
+	if(--h -> n)
+		pq_dary_sift_down(h, 0, h -> a[h -> n]);
+	*id = top.item -> id;
+	pool_free(&pq_dary_pool, top.item);
+	return top.key;
+}
+
+static inline void pq_dary_decrease_key(void *q, pq_handle handle, int key) {
+	pq_dary *h = (pq_dary *)q;
+	pq_dary_item *item = (pq_dary_item *)handle;
+	pq_dary_sift_up(h, item -> pos, (pq_dary_entry) {key, item});
+}
+
+// Append other's entries: a small queue is sifted in entry by entry
+// (O(m log n)), a large one by heapifying everything bottom-up (O(n + m))
+static inline void pq_dary_meld(void *q, void *other) {
+	pq_dary *a = (pq_dary *)q, *b = (pq_dary *)other;
+	if(!b -> n)
+		return;
+	pq_dary_reserve(a, a -> n + b -> n);
+	if(b -> n * 16 < a -> n) {
+		for(int i = 0; i < b -> n; i++)
+			pq_dary_sift_up(a, a -> n++, b -> a[i]);
+	} else {
+		for(int i = 0; i < b -> n; i++) {
+			b -> a[i].item -> pos = a -> n;
+			a -> a[a -> n++] = b -> a[i];
+		}
+		for(int i = a -> n > 1 ? (a -> n - 2) / PQ_ARITY : -1; i >= 0; i--)
+			pq_dary_sift_down(a, i, a -> a[i]);
+	}
+	b -> n = 0;
+}
+
+static inline void pq_dary_release(void) {
+	pool_destroy(&pq_dary_pool);
+}
+
+static inline size_t pq_dary_bytes(void) {
+	return pq_dary_pool.bytes + pq_dary_array_bytes;
+}
+
+static const pq_engine pq_dary_engine = {
+	"4-ary", pq_dary_create, pq_dary_destroy, pq_dary_insert,
+	pq_dary_find_min, pq_dary_extract_min, pq_dary_decrease_key,
+	pq_dary_meld, pq_dary_release, pq_dary_bytes
+};
+
+// ---- Monotone radix heap ----
+// Keys must be non-negative and no smaller than the last extracted key
+// (true for Dijkstra-style and event-queue workloads). Bucket 0 holds
+// keys equal to last, bucket b keys whose highest bit differing from
+// last is bit b - 1. When bucket 0 runs dry the first non-empty bucket
+// is scanned for its minimum, which becomes last, and its items are
+// redistributed into strictly lower buckets, so each item moves at most
+// 32 times over its lifetime.
+
+#define PQ_RADIX_BUCKETS 33
+
+typedef struct pq_radix_item {
+	struct pq_radix_item *prev;
+	struct pq_radix_item *next;
+	unsigned key;
+	int id;
+	int bucket;
+} pq_radix_item;
+
+typedef struct pq_radix {
+	pq_radix_item *bucket[PQ_RADIX_BUCKETS];
+	unsigned last;
+} pq_radix;
+
+static pool pq_radix_pool = POOL_INIT(pq_radix_item);
+
+static inline void pq_radix_push(pq_radix *h, pq_radix_item *x) {
+	int b = x -> key == h -> last ? 0 : 32 - __builtin_clz(x -> key ^ h -> last);
+	x -> bucket = b;
+	x -> prev = NULL;
+	x -> next = h -> bucket[b];
+	if(x -> next)
+		x -> next -> prev = x;
+	h -> bucket[b] = x;
+}
+
+static inline void pq_radix_unlink(pq_radix *h, pq_radix_item *x) {
+	if(x -> prev)
+		x -> prev -> next = x -> next;
+	else
+		h -> bucket[x -> bucket] = x -> next;
+	if(x -> next)
+		x -> next -> prev = x -> prev;
+}
+
+// Make sure bucket 0 holds the minimum
+static inline void pq_radix_refill(pq_radix *h) {
+	if(h -> bucket[0])
+		return;
+	int b = 1;
+	while(!h -> bucket[b])
+		b++;
+	pq_radix_item *x = h -> bucket[b];
+	h -> bucket[b] = NULL;
+	unsigned min = x -> key;
+	for(pq_radix_item *y = x -> next; y; y = y -> next)
+		if(y -> key < min)
+			min = y -> key;
+	h -> last = min;
+	while(x) {
+		pq_radix_item *next = x -> next;
+		pq_radix_push(h, x);
+		x = next;
+	}
+}
+
+static inline void *pq_radix_create(void) {
+	return calloc(1, sizeof(pq_radix));
+}
+
+static inline void pq_radix_destroy(void *q) {
+	free(q);
+}
+
+static inline pq_handle pq_radix_insert(void *q, int key, int id) {
+	pq_radix_item *x = (pq_radix_item *)pool_alloc(&pq_radix_pool);
+	x -> key = (unsigned)key;
+	x -> id = id;
+	pq_radix_push((pq_radix *)q, x);
+	return x;
+}
+
+static inline int pq_radix_find_min(void *q) {
+	pq_radix *h = (pq_radix *)q;
+	pq_radix_refill(h);
+	return (int)h -> bucket[0] -> key;
+}
+
+static inline int pq_radix_extract_min(void *q, int *id) {
+	pq_radix *h = (pq_radix *)q;
+	pq_radix_refill(h);
+	pq_radix_item *x = h -> bucket[0];
+	pq_radix_unlink(h, x);
+	int key = (int)x -> key;
+	*id = x -> id;
+	pool_free(&pq_radix_pool, x);
+	return key;
+}
+
+static inline void pq_radix_decrease_key(void *q, pq_handle handle, int key) {
+	pq_radix *h = (pq_radix *)q;
+	pq_radix_item *x = (pq_radix_item *)handle;
+	pq_radix_unlink(h, x);
+	x -> key = (unsigned)key;
+	pq_radix_push(h, x);
+}
+
+// Buckets are relative to each queue's last key, so other's items are
+// re-bucketed one by one (O(m)); they must not be below q's last key
+static inline void pq_radix_meld(void *q, void *other) {
+	pq_radix *a = (pq_radix *)q, *b = (pq_radix *)other;
+	for(int i = 0; i < PQ_RADIX_BUCKETS; i++) {
+		pq_radix_item *x = b -> bucket[i];
+		b -> bucket[i] = NULL;
+		while(x) {
+			pq_radix_item *next = x -> next;
+			pq_radix_push(a, x);
+			x = next;
+		}
+	}
+}
+
+static inline void pq_radix_release(void) {
+	pool_destroy(&pq_radix_pool);
+}
+
+static inline size_t pq_radix_bytes(void) {
+	return pq_radix_pool.bytes;
+}
+
+static const pq_engine pq_radix_engine = {
+	"radix", pq_radix_create, pq_radix_destroy, pq_radix_insert,
+	pq_radix_find_min, pq_radix_extract_min, pq_radix_decrease_key,
+	pq_radix_meld, pq_radix_release, pq_radix_bytes
+};
+
+// ---- Operation traces ----
+// A trace is generated once by simulating it on the 4-ary heap and then
+// replayed on every engine, which must extract exactly the recorded
+// (key, id) pairs. Keys are priority * ids + id, which keeps them unique
+// (so no engine can break a tie differently) and every trace is
+// monotone, so the radix heap can run all of them.
+
+enum { PQ_INSERT, PQ_DECREASE, PQ_FIND_MIN, PQ_EXTRACT, PQ_MELD };
+
+typedef struct pq_op {
+	int kind;
+	int q;		// queue 0 or 1; PQ_MELD melds queue 1 into queue 0
+	int id;
+	int key;	// new key, or the expected minimum for PQ_FIND_MIN and PQ_EXTRACT
+} pq_op;
+
+typedef struct pq_trace {
+	const char *name;
+	pq_op *ops;
+	long len;
+	long cap;
+	int ids;			// ids are 0 .. ids - 1
+	long count[5];		// ops of each kind
+	long peak_items;	// most items alive at once
+	long peak_at;		// op index at which that was first reached
+} pq_trace;
+
+// Simulation state used while generating a trace
+typedef struct pq_sim {
+	pq_trace *t;
+	void *q[2];
+	pq_handle *h;
+	int *key;		// current key of each live id
+	char *where;	// 0 not queued, else 1 + queue
+	int *pending;	// ids in queue 1
+	int npending;
+	long live;
+} pq_sim;
+
+static inline void pq_record(pq_sim *s, int kind, int q, int id, int key) {
+	pq_trace *t = s -> t;
+	if(t -> len == t -> cap) {
+		t -> cap = t -> cap ? t -> cap * 2 : 1024;
+		t -> ops = (pq_op *)realloc(t -> ops, t -> cap * sizeof(pq_op));
+	}
+	t -> ops[t -> len++] = (pq_op) {kind, q, id, key};
+	t -> count[kind]++;
+	if(s -> live > t -> peak_items) {
+		t -> peak_items = s -> live;
+		t -> peak_at = t -> len;
+	}
+}
+
+// Largest priority whose keys fit in an int
+static inline long pq_max_prio(const pq_sim *s) {
+	return INT_MAX / s -> t -> ids - 1;
+}
+
+// Unique key for a priority (clamped to pq_max_prio)
+static inline int pq_key(const pq_sim *s, long prio, int id) {
+	long max = pq_max_prio(s);
+	return (int)((prio < max ? prio : max) * s -> t -> ids + id);
+}
+
+static inline void pq_sim_insert(pq_sim *s, int q, int id, int key) {
+	s -> h[id] = pq_dary_insert(s -> q[q], key, id);
+	s -> key[id] = key;
+	s -> where[id] = 1 + q;
+	if(q)
+		s -> pending[s -> npending++] = id;
+	s -> live++;
+	pq_record(s, PQ_INSERT, q, id, key);
+}
+
+static inline void pq_sim_decrease(pq_sim *s, int id, int key) {
+	pq_dary_decrease_key(s -> q[s -> where[id] - 1], s -> h[id], key);
+	s -> key[id] = key;
+	pq_record(s, PQ_DECREASE, s -> where[id] - 1, id, key);
+}
+
+static inline int pq_sim_extract(pq_sim *s) {
+	int id;
+	int key = pq_dary_extract_min(s -> q[0], &id);
+	s -> where[id] = 0;
+	s -> live--;
+	pq_record(s, PQ_EXTRACT, 0, id, key);
+	return id;
+}
+
+static inline void pq_sim_find_min(pq_sim *s) {
+	int key = pq_dary_find_min(s -> q[0]);
+	pq_record(s, PQ_FIND_MIN, 0, key % s -> t -> ids, key);
+}
+
+static inline void pq_sim_meld(pq_sim *s) {
+	pq_dary_meld(s -> q[0], s -> q[1]);
+	while(s -> npending)
+		s -> where[s -> pending[--s -> npending]] = 1;
+	pq_record(s, PQ_MELD, 0, -1, 0);
+}
+
+static inline pq_sim pq_sim_start(pq_trace *t, const char *name, int ids) {
+	*t = (pq_trace) {.name = name, .ids = ids};
+	pq_sim s = {t, {pq_dary_create(), pq_dary_create()}, NULL, NULL, NULL, NULL, 0, 0};
+	s.h = (pq_handle *)malloc(ids * sizeof(pq_handle));
+	s.pending = (int *)malloc(ids * sizeof(int));
+	s.key = (int *)malloc(ids * sizeof(int));
+	s.where = (char *)calloc(ids, 1);
+	return s;
+}
+
+static inline void pq_sim_end(pq_sim *s) {
+	while(s -> live)
+		pq_sim_extract(s);
+	pq_dary_destroy(s -> q[0]);
+	pq_dary_destroy(s -> q[1]);
+	pq_dary_release();
+	free(s -> h);
+	free(s -> key);
+	free(s -> where);
+	free(s -> pending);
+}
+
+// Heap sort: n random inserts, then n extractions
+static inline void pq_trace_sort(pq_trace *t, int n, uint64_t seed) {
+	pq_sim s = pq_sim_start(t, "sort", n);
+	for(int id = 0; id < n; id++)
+		pq_sim_insert(&s, 0, id, pq_key(&s, (long)(bench_rand(&seed) % pq_max_prio(&s)), id));
+	pq_sim_end(&s);
+}
+
+// Dijkstra on a random graph of n vertices and the given out-degree with
+// edge weights 1..64: every extraction relaxes its edges, inserting
+// unseen vertices and decreasing keys that improve
+static inline void pq_trace_dijkstra(pq_trace *t, int n, int degree, uint64_t seed) {
+	pq_sim s = pq_sim_start(t, "dijkstra", n);
+	char *done = (char *)calloc(n, 1);
+	int next_source = 0;
+	for(;;) {
+		if(!s.live) {
+			while(next_source < n && done[next_source])
+				next_source++;
+			if(next_source == n)
+				break;
+			pq_sim_insert(&s, 0, next_source, pq_key(&s, 0, next_source));
+		}
+		int u = pq_sim_extract(&s);
+		done[u] = 1;
+		long dist = s.key[u] / n;
+		for(int e = 0; e < degree; e++) {
+			uint64_t r = bench_rand(&seed);
+			int v = (int)((r >> 32) % n);
+			int key = pq_key(&s, dist + 1 + (long)(r % 64), v);
+			if(done[v])
+				continue;
+			if(!s.where[v])
+				pq_sim_insert(&s, 0, v, key);
+			else if(key < s.key[v])
+				pq_sim_decrease(&s, v, key);
+		}
+	}
+	free(done);
+	pq_sim_end(&s);
+}
+
+// Event queue fed in bursts: each round fills queue 1 with a burst of new
+// events due within the next 64 priorities, melds it into queue 0,
+// decreases a few queued events, peeks and drains a burst. The queue
+// hovers around n / 2 items; the trace stops after ops ops, or earlier if
+// the clock gets close to pq_max_prio.
+static inline void pq_trace_meld(pq_trace *t, int n, long ops, uint64_t seed) {
+	pq_sim s = pq_sim_start(t, "meld", n);
+	int *free_ids = (int *)malloc(n * sizeof(int));
+	int nfree = n;
+	for(int i = 0; i < n; i++)
+		free_ids[i] = n - 1 - i;
+	long now = 0;
+
+	while(t -> len < ops && now + 64 < pq_max_prio(&s)) {
+		uint64_t r = bench_rand(&seed);
+		int burst = 1 + (int)(r % 128);
+		for(int i = 0; i < burst && nfree; i++) {
+			int id = free_ids[--nfree];
+			pq_sim_insert(&s, 1, id, pq_key(&s, now + 1 + (long)(bench_rand(&seed) % 64), id));
+		}
+		pq_sim_meld(&s);
+
+		for(int i = 0; i < burst / 4; i++) {
+			uint64_t x = bench_rand(&seed);
+			int id = (int)((x >> 32) % n);
+			long prio = s.key[id] / n;
+			if(s.where[id] && prio > now + 1)
+				pq_sim_decrease(&s, id, pq_key(&s, now + 1 + (long)(x % (prio - now - 1)), id));
+		}
+
+		int drain = s.live > n / 2 ? burst : burst / 2;
+		for(int i = 0; i < drain && s.live; i++) {
+			if(!i)
+				pq_sim_find_min(&s);
+			int id = pq_sim_extract(&s);
+			now = s.key[id] / n;
+			free_ids[nfree++] = id;
+		}
+	}
+	free(free_ids);
+	pq_sim_end(&s);
+}
+
+// Replay a trace on an engine; returns ns per operation and sets
+// *bytes_per_item to the engine's memory at the trace's peak size divided
+// by the items alive then. Returns -1 if an extraction came out wrong.
+static inline double pq_run(const pq_engine *e, const pq_trace *t, double *bytes_per_item) {
+	pq_handle *h = (pq_handle *)malloc(t -> ids * sizeof(pq_handle));
+	void *q[2] = {e -> create(), e -> create()};
+	long wrong = 0;
+	*bytes_per_item = 0;
+
+	double start = now_sec();
+	for(long i = 0; i < t -> len; i++) {
+		const pq_op *op = &t -> ops[i];
+		int id;
+		switch(op -> kind) {
+		case PQ_INSERT:
+			h[op -> id] = e -> insert(q[op -> q], op -> key, op -> id);
+			break;
+		case PQ_DECREASE:
+			e -> decrease_key(q[op -> q], h[op -> id], op -> key);
+			break;
+		case PQ_FIND_MIN:
+			wrong += e -> find_min(q[op -> q]) != op -> key;
+			break;
+		case PQ_EXTRACT:
+			wrong += e -> extract_min(q[op -> q], &id) != op -> key || id != op -> id;
+			break;
+		case PQ_MELD:
+			e -> meld(q[0], q[1]);
+			break;
+		}
+		if(i + 1 == t -> peak_at)
+			*bytes_per_item = (double)e -> bytes() / t -> peak_items;
+	}
+	double elapsed = now_sec() - start;
+
+	e -> destroy(q[0]);
+	e -> destroy(q[1]);
+	e -> release();
+	free(h);
+	return wrong ? -1 : elapsed / t -> len * 1e9;
+}
+
+// Run the sort, dijkstra and meld traces over n ids through every engine
+// and print ns/op and bytes per item for each
+static inline int pq_bench(const pq_engine *const *engines, int count, int n) {
+	pq_trace t;
+	for(int w = 0; w < 3; w++) {
+		if(w == 0)
+			pq_trace_sort(&t, n, 1);
+		else if(w == 1)
+			pq_trace_dijkstra(&t, n, 8, 2);
+		else
+			pq_trace_meld(&t, n, 8L * n, 3);
+
+		printf("%s: %d ids, %ld ops (%ld insert, %ld decrease, %ld find-min, %ld extract, %ld meld), peak %ld items\n",
+		       t.name, t.ids, t.len, t.count[PQ_INSERT], t.count[PQ_DECREASE], t.count[PQ_FIND_MIN],
+		       t.count[PQ_EXTRACT], t.count[PQ_MELD], t.peak_items);
+		for(int i = 0; i < count; i++) {
+			double bytes;
+			double ns = pq_run(engines[i], &t, &bytes);
+			if(ns < 0)
+				printf("  %-14s WRONG RESULTS\n", engines[i] -> name);
+			else
+				printf("  %-14s %8.1f ns/op %6.1f bytes/item\n", engines[i] -> name, ns, bytes);
+		}
+		free(t.ops);
+	}
+	return 0;
+}
+
+#endif